@@ -0,0 +1,261 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <mutex>
+#include <algorithm>
+
+#include "acquisitionCatalog.h"
+
+#define CATALOG_FILE_MAGIC    0x41544347   /* "ATCG" */
+#define CATALOG_FILE_VERSION  1
+#define CATALOG_FILE_CHUNK    65536
+
+/* File layout: uint32_t magic, uint32_t version, then per DaqMux a
+ * uint64_t entry count followed by the packed entries.
+ */
+
+static bool earlier(const catalog_entry_t &a, const catalog_entry_t &b)
+{
+    return a.timestamp < b.timestamp;
+}
+
+static catalog_entry_t entryAt(uint64_t timestamp)
+{
+    catalog_entry_t e;
+
+    e.timestamp = timestamp;
+    e.location  = 0;
+    e.trigCount = 0;
+    return e;
+}
+
+class CAcquisitionCatalog : public IAcquisitionCatalog {
+    protected:
+        std::mutex                    _lock;
+        uint64_t                      _maxEntries;
+        std::deque<catalog_entry_t>   _entries[MAX_DAQMUX_CNT];
+        stream_format_t               _format[MAX_DEBUG_STREAM];
+        AcquisitionLocator            _locator;
+
+        void insert(int index, const catalog_entry_t &e);
+
+    public:
+        CAcquisitionCatalog(uint64_t maxEntries, AcquisitionLocator locator);
+
+        virtual void setFormat(uint32_t stream, const stream_format_t *format);
+        virtual void processFrame(const stream_frame_t *frame);
+        virtual void add(int index, uint64_t timestamp, uint32_t trigCount, uint64_t location);
+        virtual void record(ATCACommonFw fw, int index, uint64_t location);
+        virtual uint64_t find(int index, uint64_t start, uint64_t end, std::vector<catalog_entry_t> *entries);
+        virtual int      findNearest(int index, uint64_t timestamp, catalog_entry_t *entry);
+        virtual uint64_t size(int index);
+        virtual void     clear();
+        virtual int save(const char *fileName);
+        virtual int load(const char *fileName);
+};
+
+AcquisitionCatalog IAcquisitionCatalog::create(uint64_t maxEntries, AcquisitionLocator locator)
+{
+    return AcquisitionCatalog(new CAcquisitionCatalog(maxEntries, locator));
+}
+
+CAcquisitionCatalog::CAcquisitionCatalog(uint64_t maxEntries, AcquisitionLocator locator) :
+    _maxEntries(maxEntries),
+    _locator(locator)
+{
+    memset(_format, 0, sizeof(_format));
+}
+
+void CAcquisitionCatalog::setFormat(uint32_t stream, const stream_format_t *format)
+{
+    _format[stream] = *format;
+}
+
+void CAcquisitionCatalog::insert(int index, const catalog_entry_t &e)
+{
+    std::deque<catalog_entry_t> *d = &_entries[index];
+
+    /* acquisitions normally arrive in time order */
+    if(d->empty() || d->back().timestamp <= e.timestamp)
+        d->push_back(e);
+    else
+        d->insert(std::upper_bound(d->begin(), d->end(), e, earlier), e);
+
+    if(_maxEntries && d->size() > _maxEntries) d->pop_front();
+}
+
+void CAcquisitionCatalog::add(int index, uint64_t timestamp, uint32_t trigCount, uint64_t location)
+{
+    catalog_entry_t e;
+
+    e.timestamp = timestamp;
+    e.location  = location;
+    e.trigCount = trigCount;
+
+    std::lock_guard<std::mutex> lock(_lock);
+    insert(index, e);
+}
+
+void CAcquisitionCatalog::record(ATCACommonFw fw, int index, uint64_t location)
+{
+    uint32_t sec, nsec, trigCount;
+
+    fw->getAcquisition(&sec, &nsec, &trigCount, index);
+    add(index, (uint64_t) sec << 32 | nsec, trigCount, location);
+}
+
+void CAcquisitionCatalog::processFrame(const stream_frame_t *frame)
+{
+    daqmux_header_t  header;
+    catalog_entry_t  e;
+
+    if(!_locator || frame->stream >= MAX_DEBUG_STREAM || !_format[frame->stream].header ||
+       parseStreamHeader(frame, &header))
+        return;
+
+    int index = frame->stream / STREAMS_PER_DAQMUX;
+
+    e.timestamp = streamHeaderTimestamp(&header);
+    e.trigCount = CATALOG_TRIGCOUNT_NONE;
+
+    std::lock_guard<std::mutex> lock(_lock);
+    std::deque<catalog_entry_t> *d = &_entries[index];
+
+    /* every channel of the acquisition carries its timestamp, record it once */
+    if(!d->empty() && e.timestamp <= d->back().timestamp &&
+       std::binary_search(d->begin(), d->end(), e, earlier))
+        return;
+
+    e.location = _locator->locate(frame);
+    insert(index, e);
+}
+
+uint64_t CAcquisitionCatalog::find(int index, uint64_t start, uint64_t end, std::vector<catalog_entry_t> *entries)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    std::deque<catalog_entry_t> *d = &_entries[index];
+
+    std::deque<catalog_entry_t>::iterator first = std::lower_bound(d->begin(), d->end(), entryAt(start), earlier);
+    std::deque<catalog_entry_t>::iterator last  = std::upper_bound(first, d->end(), entryAt(end), earlier);
+
+    entries->assign(first, last);
+    return entries->size();
+}
+
+int CAcquisitionCatalog::findNearest(int index, uint64_t timestamp, catalog_entry_t *entry)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    std::deque<catalog_entry_t> *d = &_entries[index];
+
+    if(d->empty())
+        return -1;
+
+    std::deque<catalog_entry_t>::iterator i = std::lower_bound(d->begin(), d->end(), entryAt(timestamp), earlier);
+    if(i == d->end() || (i != d->begin() && timestamp - (i - 1)->timestamp < i->timestamp - timestamp))
+        i--;
+
+    *entry = *i;
+    return 0;
+}
+
+uint64_t CAcquisitionCatalog::size(int index)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _entries[index].size();
+}
+
+void CAcquisitionCatalog::clear()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++) _entries[i].clear();
+}
+
+int CAcquisitionCatalog::save(const char *fileName)
+{
+    uint32_t                      head[2] = { CATALOG_FILE_MAGIC, CATALOG_FILE_VERSION };
+    std::vector<catalog_entry_t>  chunk;
+    FILE                         *fp;
+    int                           rval = 0;
+
+    if(!(fp = fopen(fileName, "wb"))) {
+        fprintf(stderr, "IAcquisitionCatalog: cannot open %s\n", fileName);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if(fwrite(head, sizeof(head), 1, fp) != 1)
+        rval = -1;
+
+    for(int i = 0; i < MAX_DAQMUX_CNT && !rval; i++) {
+        uint64_t n = _entries[i].size();
+        if(fwrite(&n, sizeof(n), 1, fp) != 1) {
+            rval = -1;
+            break;
+        }
+        /* the deque is not contiguous, write through a chunk buffer */
+        for(uint64_t j = 0; j < n && !rval; j += chunk.size()) {
+            uint64_t m = n - j < CATALOG_FILE_CHUNK ? n - j : CATALOG_FILE_CHUNK;
+            chunk.assign(_entries[i].begin() + j, _entries[i].begin() + j + m);
+            if(fwrite(chunk.data(), sizeof(catalog_entry_t), m, fp) != m) rval = -1;
+        }
+    }
+
+    if(fclose(fp)) rval = -1;
+    if(rval) fprintf(stderr, "IAcquisitionCatalog: cannot write %s\n", fileName);
+    return rval;
+}
+
+int CAcquisitionCatalog::load(const char *fileName)
+{
+    uint32_t                      head[2];
+    std::deque<catalog_entry_t>   entries[MAX_DAQMUX_CNT];
+    std::vector<catalog_entry_t>  chunk(CATALOG_FILE_CHUNK);
+    FILE                         *fp;
+    int                           rval = 0;
+
+    if(!(fp = fopen(fileName, "rb"))) {
+        fprintf(stderr, "IAcquisitionCatalog: cannot open %s\n", fileName);
+        return -1;
+    }
+
+    if(fread(head, sizeof(head), 1, fp) != 1 || head[0] != CATALOG_FILE_MAGIC || head[1] != CATALOG_FILE_VERSION)
+        rval = -1;
+
+    for(int i = 0; i < MAX_DAQMUX_CNT && !rval; i++) {
+        uint64_t n;
+        if(fread(&n, sizeof(n), 1, fp) != 1) {
+            rval = -1;
+            break;
+        }
+        for(uint64_t j = 0; j < n && !rval; j += CATALOG_FILE_CHUNK) {
+            uint64_t m = n - j < CATALOG_FILE_CHUNK ? n - j : CATALOG_FILE_CHUNK;
+            if(fread(chunk.data(), sizeof(catalog_entry_t), m, fp) != m) rval = -1;
+            else entries[i].insert(entries[i].end(), chunk.begin(), chunk.begin() + m);
+        }
+        if(!rval && !std::is_sorted(entries[i].begin(), entries[i].end(), earlier)) rval = -1;
+    }
+    fclose(fp);
+
+    if(rval) {
+        fprintf(stderr, "IAcquisitionCatalog: %s is not a valid catalog\n", fileName);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++) {
+        _entries[i].swap(entries[i]);
+        while(_maxEntries && _entries[i].size() > _maxEntries) _entries[i].pop_front();
+    }
+    return 0;
+}
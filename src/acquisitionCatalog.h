@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _ACQUISITION_CATALOG_H
+#define _ACQUISITION_CATALOG_H
+
+#include <vector>
+
+#include "atcaCommon.h"
+
+#define CATALOG_TRIGCOUNT_NONE  0xffffffff    /* recorded from the stream, TrigCount not known */
+
+/* 20 bytes per acquisition */
+typedef struct __attribute__ ((packed)) {
+    uint64_t  timestamp;      // Timestamp[0] << 32 | Timestamp[1]
+    uint64_t  location;       // caller defined, e.g. file offset or frame number
+    uint32_t  trigCount;
+} catalog_entry_t;
+
+class IAcquisitionLocator;
+typedef shared_ptr<IAcquisitionLocator> AcquisitionLocator;
+
+/* Tells where the frame opening an acquisition is stored, e.g. the file
+ * offset a recorder writes it at; called from the reader thread */
+class IAcquisitionLocator {
+public:
+    virtual uint64_t locate(const stream_frame_t *frame) = 0;
+    virtual ~IAcquisitionLocator() {}
+};
+
+class IAcquisitionCatalog;
+typedef shared_ptr<IAcquisitionCatalog> AcquisitionCatalog;
+
+/* Searchable record of the acquisitions of both DaqMuxes.
+ *
+ * Entries are kept sorted by timestamp per DaqMux, so appending in
+ * acquisition order is O(1) and range lookups are binary searches. At
+ * most maxEntries are held per DaqMux (0: unlimited); the oldest are
+ * dropped first. save()/load() return 0 on success, -1 on I/O error or
+ * a file which is not a catalog.
+ *
+ * Created with a locator and attached with addStreamSink(), the catalog
+ * records every acquisition as its frames arrive: one entry per new header
+ * timestamp of a DaqMux, located by the locator. The firmware TrigCount
+ * cannot be read from the reader thread, so these entries carry
+ * CATALOG_TRIGCOUNT_NONE. Only streams whose format has a header are
+ * recorded; call setFormat() before attaching. Without a locator frames
+ * are ignored and the catalog is filled by add() and record() only.
+ */
+class IAcquisitionCatalog : public IStreamFrameSink {
+public:
+    static AcquisitionCatalog create(uint64_t maxEntries, AcquisitionLocator locator = AcquisitionLocator());
+
+    virtual void setFormat(uint32_t stream, const stream_format_t *format) = 0;
+    virtual void add(int index, uint64_t timestamp, uint32_t trigCount, uint64_t location) = 0;
+    /* read Timestamp and TrigCount of the last acquisition from the firmware */
+    virtual void record(ATCACommonFw fw, int index, uint64_t location) = 0;
+
+    /* entries with start <= timestamp <= end, oldest first */
+    virtual uint64_t find(int index, uint64_t start, uint64_t end, std::vector<catalog_entry_t> *entries) = 0;
+    /* entry closest in time; return -1 if the catalog is empty */
+    virtual int      findNearest(int index, uint64_t timestamp, catalog_entry_t *entry) = 0;
+    virtual uint64_t size(int index) = 0;
+    virtual void     clear() = 0;
+
+    virtual int save(const char *fileName) = 0;
+    virtual int load(const char *fileName) = 0;
+    virtual ~IAcquisitionCatalog() {}
+};
+
+#endif /* _ACQUISITION_CATALOG_H */
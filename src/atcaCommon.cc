@@ -14,21 +14,21 @@
 #include <cpsw_hub.h>
 #include <fstream>
 #include <sstream>
+#include <mutex>
+#include <vector>
 
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include "atcaCommon.h"
 
-#define MAX_DEBUG_STREAM   8
-#define MAX_DAQMUX_CNT     2
-#define MAX_AMC_CNT        2
 #define MAX_WAVEFORMENGINE_CNT 2
 
-#define MAX_JESD_CNT       6
-#define NUM_JESD           2
 #define JESD_CNT_STR       "JesdRx/StatusValidCnt[%d]"
 
+#define ACQUISITION_READ_RETRY 3
+
 #define CPSW_TRY_CATCH(X)       try {   \
         (X);                            \
     } catch (CPSWError &e) {            \
@@ -65,6 +65,9 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
 // debug stream
         Stream      _stream[MAX_DEBUG_STREAM];
 
+// debug stream statistics and sinks
+        CDebugStreamDispatch   _dispatch;      // also keeps the FrameCnt of the last reset
+
 // Common
         ScalVal_RO   _upTimeCnt;
         ScalVal_RO   _buildStamp;
@@ -110,17 +113,39 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
 // Waveform Engines
 
         struct {
-        ScalVal     _startAddr[4];
-        ScalVal     _endAddr[4];
-        ScalVal_RO  _wrAddr[4];
-        ScalVal     _enabled[4];
-        ScalVal     _mode[4];
-        ScalVal     _msgDest[4];
-        ScalVal     _framesAfterTrigger[4];
-        ScalVal_RO  _status[4];
+        ScalVal     _startAddr[WFE_CHANNEL_CNT];
+        ScalVal     _endAddr[WFE_CHANNEL_CNT];
+        ScalVal_RO  _wrAddr[WFE_CHANNEL_CNT];
+        ScalVal     _enabled[WFE_CHANNEL_CNT];
+        ScalVal     _mode[WFE_CHANNEL_CNT];
+        ScalVal     _msgDest[WFE_CHANNEL_CNT];
+        ScalVal     _framesAfterTrigger[WFE_CHANNEL_CNT];
+        ScalVal_RO  _status[WFE_CHANNEL_CNT];
         Command     _initialize;
         } _waveformEngine[MAX_WAVEFORMENGINE_CNT];
 
+// Locking: one mutex per DaqMux, per waveform engine and per debug stream.
+// Common (AxiVersion/JESD/AmcClkFreq) registers are read-only single reads
+// and rely on CPSW's own thread safety. When more than one lock is needed
+// they are always taken in the order DaqMux -> waveform engine.
+        std::mutex   _daqMuxLock[MAX_DAQMUX_CNT];
+        std::mutex   _waveformEngineLock[MAX_WAVEFORMENGINE_CNT];
+        std::mutex   _streamLock[MAX_DEBUG_STREAM];
+
+// writable registers covered by saveConfig()/restoreConfig(), in snapshot order
+        typedef struct {
+            ScalVal      reg;
+            unsigned     bytes;     // bytes in the snapshot
+            std::mutex  *lock;
+            int          wfe;       // waveform engine to re-initialize after a write, or -1
+        } config_reg_t;
+        std::vector<config_reg_t> _configRegs;
+
+        void addConfigReg(ScalVal reg, unsigned bytes, std::mutex *lock, int wfe);
+        int  readConfig(std::vector<uint64_t> *vals);
+        int  configureWaveformEngine(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize,
+                                     uint32_t mode, uint32_t framesAfterTriggerVal);
+
         enum WFEMsgDstEnums{
             WFEMsgDstSoftware = 0,
             WFEMsgDstAutoReadOut = 1
@@ -155,6 +180,12 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
         CATCACommonFwAdapt(Key &k, ConstPath p, shared_ptr<const CEntryImpl> ie);
         virtual void createStreams(ConstPath p, const char *prefix);
         virtual int64_t readStream(uint32_t index, uint8_t *buff, uint64_t size, CTimeout timeout);
+        virtual void getStreamStats(stream_stats_t *stats, uint32_t index);
+        virtual void getStreamLoss(stream_loss_t *loss, uint32_t index);
+        virtual void resetStreamStats(uint32_t index);
+        virtual void getStreamFormat(stream_format_t *format, uint32_t index);
+        virtual void addStreamSink(StreamFrameSink sink, uint32_t index);
+        virtual void removeStreamSink(StreamFrameSink sink, uint32_t index);
         virtual void getUpTimeCnt(uint32_t *cnt);
         virtual void getBuildStamp(uint8_t *str);
         virtual void getFpgaVersion(uint32_t *ver);
@@ -163,6 +194,7 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
         virtual void getGitHash(uint8_t *str);
         virtual void getJesdCnt(uint32_t *cnt, int i, int j);
         virtual void getAmcClkFreq(uint32_t *freq, int i);
+        virtual void getCommonStatus(RegisterBatch batch, common_status_t *status);
 
         // DaqMux Commands
         virtual void triggerDaq(int index);
@@ -173,12 +205,14 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
         virtual void cascadedTrigger(uint32_t cmd, int index);
         virtual void hardwareAutoRearm(uint32_t cmd, int index);
         virtual void daqMode(uint32_t cmd, int index);
+        virtual void getDaqMode(uint32_t *val, int index);
         virtual void enablePacketHeader(uint32_t cmd, int index);
         virtual void enableHardwareFreeze(uint32_t cmd, int index);
         virtual void decimationRateDivisor(uint32_t div, int index);
         virtual void dataBufferSize(uint32_t size, int index);
         virtual void getTimestamp(uint32_t *sec, uint32_t *nsec, int index);
         virtual void getTriggerCount(uint32_t *count, int index);
+        virtual void getAcquisition(uint32_t *sec, uint32_t *nsec, uint32_t *trigCount, int index);
         virtual void dbgInputValid(uint32_t *val, int index);
         virtual void dbgLinkReady(uint32_t *val, int index);
         virtual void inputMuxSelect(uint32_t val, int index, int chn);
@@ -196,6 +230,7 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
         virtual void getStreamEnabled(uint32_t *vals, int index);
         virtual void getFrameCount(uint32_t *val, int index, int chn);
         virtual void getFrameCount(uint32_t *val, int index);
+        virtual void getDaqMuxStatus(RegisterBatch batch, daqmux_status_t *status, int index);
         virtual void formatSignWidth(uint32_t val, int index, int chn);
         virtual void formatDataWidth(uint32_t val, int index, int chn);
         virtual void enableFormatSign(uint32_t val, int index, int chn);
@@ -212,12 +247,18 @@ class CATCACommonFwAdapt : public IATCACommonFw, public IEntryAdapt {
         virtual void setWfEngineMode(uint32_t val, int index, int chn);
         virtual void setWfEngineMsgDest(uint32_t val, int index, int chn);
         virtual void setWfEngineFramesAfterTrigger(uint32_t val, int index, int chn);
+        virtual void getWfEngineStatus(RegisterBatch batch, wfe_status_t *status, int index);
+        virtual void setWfEngineConfig(RegisterBatch batch, const wfe_config_t *config, int index, int chn);
 
         virtual void initWfEngine(int index);
         virtual int  setupWaveformEngine(unsigned waveFormEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize);
+        virtual int  setupWaveformEngineWrap(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize, uint32_t framesAfterTrigger);
+        virtual void getWfEngineRing(wfe_ring_t *ring, int index, int chn);
         virtual dram_region_size_t getAllocableSize(unsigned sizeInBytes);
         virtual void setupDaqMux(unsigned daqMuxIndex);
 
+        virtual int  saveConfig(std::vector<uint8_t> *blob);
+        virtual int  restoreConfig(const uint8_t *blob, uint64_t size, unsigned *written);
 };
 
 ATCACommonFw IATCACommonFw::create(Path p)
@@ -387,7 +428,7 @@ CATCACommonFwAdapt::CATCACommonFwAdapt(Key &k, ConstPath p, shared_ptr<const CEn
 
     for(int i = 0; i < MAX_WAVEFORMENGINE_CNT; i++) {
         (_waveformEngine+i)->_initialize = ICommand::create(_p_waveformEngine[i]->findByName("Initialize"));
-        for(int j = 0; j < 4; j ++) {
+        for(int j = 0; j < WFE_CHANNEL_CNT; j ++) {
             char name[80];
             sprintf(name, "StartAddr[%d]", j); (_waveformEngine+i)->_startAddr[j] = IScalVal::create(_p_waveformEngine[i]->findByName(name));
             sprintf(name, "EndAddr[%d]",   j); (_waveformEngine+i)->_endAddr[j]   = IScalVal::create(_p_waveformEngine[i]->findByName(name));
@@ -401,6 +442,34 @@ CATCACommonFwAdapt::CATCACommonFwAdapt(Key &k, ConstPath p, shared_ptr<const CEn
         }
     }
 
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++) {
+        addConfigReg((_daqMux+i)->_triggerCasc,       sizeof(uint32_t), &_daqMuxLock[i], -1);
+        addConfigReg((_daqMux+i)->_autoRearm,         sizeof(uint32_t), &_daqMuxLock[i], -1);
+        addConfigReg((_daqMux+i)->_daqMode,           sizeof(uint32_t), &_daqMuxLock[i], -1);
+        addConfigReg((_daqMux+i)->_packetHeader,      sizeof(uint32_t), &_daqMuxLock[i], -1);
+        addConfigReg((_daqMux+i)->_freezeHwMask,      sizeof(uint32_t), &_daqMuxLock[i], -1);
+        addConfigReg((_daqMux+i)->_decimationRateDiv, sizeof(uint32_t), &_daqMuxLock[i], -1);
+        addConfigReg((_daqMux+i)->_bufferSize,        sizeof(uint32_t), &_daqMuxLock[i], -1);
+        for(int j = 0; j < 4; j++) {
+            addConfigReg((_daqMux+i)->_inputMuxSel[j],     sizeof(uint32_t), &_daqMuxLock[i], -1);
+            addConfigReg((_daqMux+i)->_formatSignWidth[j], sizeof(uint32_t), &_daqMuxLock[i], -1);
+            addConfigReg((_daqMux+i)->_formatDataWidth[j], sizeof(uint32_t), &_daqMuxLock[i], -1);
+            addConfigReg((_daqMux+i)->_formatSign[j],      sizeof(uint32_t), &_daqMuxLock[i], -1);
+            addConfigReg((_daqMux+i)->_decimation[j],      sizeof(uint32_t), &_daqMuxLock[i], -1);
+        }
+    }
+
+    for(int i = 0; i < MAX_WAVEFORMENGINE_CNT; i++) {
+        for(int j = 0; j < WFE_CHANNEL_CNT; j++) {
+            addConfigReg((_waveformEngine+i)->_startAddr[j],          sizeof(uint64_t), &_waveformEngineLock[i], i);
+            addConfigReg((_waveformEngine+i)->_endAddr[j],            sizeof(uint64_t), &_waveformEngineLock[i], i);
+            addConfigReg((_waveformEngine+i)->_enabled[j],            sizeof(uint32_t), &_waveformEngineLock[i], i);
+            addConfigReg((_waveformEngine+i)->_mode[j],               sizeof(uint32_t), &_waveformEngineLock[i], i);
+            addConfigReg((_waveformEngine+i)->_msgDest[j],            sizeof(uint32_t), &_waveformEngineLock[i], i);
+            addConfigReg((_waveformEngine+i)->_framesAfterTrigger[j], sizeof(uint32_t), &_waveformEngineLock[i], i);
+        }
+    }
+
 }
 
 void CATCACommonFwAdapt::createStreams(ConstPath p, const char *prefix = NULL)
@@ -409,14 +478,100 @@ void CATCACommonFwAdapt::createStreams(ConstPath p, const char *prefix = NULL)
     char path_name[80];
 
     for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        std::lock_guard<std::mutex> lock(_streamLock[i]);
         sprintf(path_name, str_stream, i); _stream[i] =  IStream::create(p->findByName(path_name));
     } 
 
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) resetStreamStats(i);
 }
 
 int64_t CATCACommonFwAdapt::readStream(uint32_t index, uint8_t *buff, uint64_t size, CTimeout timeout)
 {
-    return _stream[index]->read(buff, size, timeout);
+    int64_t got;
+    {
+        std::lock_guard<std::mutex> lock(_streamLock[index]);
+        got = _stream[index]->read(buff, size, timeout);
+    }
+
+    /* empty polls are not timeouts; CPSW does not tell when the frame was received */
+    if(got > 0 || !timeout.isNone())
+        _dispatch.frameDone(index, buff, got, streamMonotonicTime());
+    return got;
+}
+
+void CATCACommonFwAdapt::getStreamFormat(stream_format_t *format, uint32_t index)
+{
+    int daqMuxIndex = index / STREAMS_PER_DAQMUX;
+    int chn         = index % STREAMS_PER_DAQMUX;
+
+    std::lock_guard<std::mutex> lock(_daqMuxLock[daqMuxIndex]);
+    try {
+        (_daqMux+daqMuxIndex)->_packetHeader->getVal(&format->header);
+        (_daqMux+daqMuxIndex)->_formatDataWidth[chn]->getVal(&format->dataWidth);
+        (_daqMux+daqMuxIndex)->_formatSign[chn]->getVal(&format->sign);
+    } catch (CPSWError &e) {
+        fprintf(stderr,"CPSW Error: %s at %s, line %d\n",
+                        e.getInfo().c_str(),
+                        __FILE__, __LINE__);
+        throw e;
+    }
+}
+
+void CATCACommonFwAdapt::addStreamSink(StreamFrameSink sink, uint32_t index)
+{
+    _dispatch.addSink(sink, index);
+}
+
+void CATCACommonFwAdapt::removeStreamSink(StreamFrameSink sink, uint32_t index)
+{
+    _dispatch.removeSink(sink, index);
+}
+
+void CATCACommonFwAdapt::getStreamStats(stream_stats_t *stats, uint32_t index)
+{
+    _dispatch.getStats(stats, index);
+}
+
+void CATCACommonFwAdapt::getStreamLoss(stream_loss_t *loss, uint32_t index)
+{
+    int      daqMuxIndex = index / STREAMS_PER_DAQMUX;
+    int      chn         = index % STREAMS_PER_DAQMUX;
+    uint32_t frameCnt;
+    uint64_t frameCntBase;
+
+    {
+        std::lock_guard<std::mutex> lock(_daqMuxLock[daqMuxIndex]);
+        try {
+            (_daqMux+daqMuxIndex)->_frameCnt[chn]->getVal(&frameCnt);
+            (_daqMux+daqMuxIndex)->_streamOverflow[chn]->getVal(&loss->overflow);
+            (_daqMux+daqMuxIndex)->_streamPause[chn]->getVal(&loss->pause);
+        } catch (CPSWError &e) {
+            fprintf(stderr,"CPSW Error: %s at %s, line %d\n",
+                            e.getInfo().c_str(),
+                            __FILE__, __LINE__);
+            throw e;
+        }
+    }
+
+    loss->hostFrames = _dispatch.getHostFrames(index, &frameCntBase);
+    loss->hwFrames   = frameCnt - (uint32_t) frameCntBase;   /* FrameCnt wraps at 32 bits */
+    loss->lostFrames = (int64_t) loss->hwFrames - (int64_t) loss->hostFrames;
+}
+
+void CATCACommonFwAdapt::resetStreamStats(uint32_t index)
+{
+    uint64_t frameCntBase;
+    uint32_t frameCnt;
+
+    _dispatch.getHostFrames(index, &frameCntBase);
+    frameCnt = (uint32_t) frameCntBase;
+    try {
+        getFrameCount(&frameCnt, index / STREAMS_PER_DAQMUX, index % STREAMS_PER_DAQMUX);
+    } catch (CPSWError &e) {
+        /* keep the previous baseline, already reported by getFrameCount() */
+    }
+
+    _dispatch.resetStats(index, frameCnt);
 }
 
 
@@ -473,6 +628,23 @@ void CATCACommonFwAdapt::getJesdCnt(uint32_t *cnt, int i, int j)
     }
 }
 
+/* common registers have no adapter lock, see the locking note */
+void CATCACommonFwAdapt::getCommonStatus(RegisterBatch batch, common_status_t *status)
+{
+    batch->get(_upTimeCnt,    &status->upTimeCnt);
+    batch->get(_fpgaVersion,  &status->fpgaVersion);
+    batch->get(_fpgaTemp,     &status->fpgaTemperature);
+    batch->get(_EthUpTimeCnt, &status->ethUpTimeCnt);
+    for(int i = 0; i < MAX_AMC_CNT; i++) {
+        if(_p_amcClkFreq[i] != NULL) batch->get(_amcClkFreq[i], status->amcClkFreq + i);
+        else                         status->amcClkFreq[i] = 0;
+    }
+    for(int j = 0; j < MAX_JESD_CNT; j++) {
+        batch->get(_jesd0ValidCnt[j], &status->jesdCnt[0][j]);
+        batch->get(_jesd1ValidCnt[j], &status->jesdCnt[1][j]);
+    }
+}
+
 void CATCACommonFwAdapt::getGitHash(uint8_t *str)
 {
     uint8_t githash[32];
@@ -487,61 +659,79 @@ void CATCACommonFwAdapt::getGitHash(uint8_t *str)
 
 void CATCACommonFwAdapt::triggerDaq(int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_triggerDaq->execute());
 }
 
 void CATCACommonFwAdapt::armHwTrigger(int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_armHwTrigger->execute());
 }
 
 void CATCACommonFwAdapt::freezeBuffer(int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_freezeBuffers->execute());
 }
 
 void CATCACommonFwAdapt::clearTriggerStatus(int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_clearTrigStatus->execute());
 }
 
 void CATCACommonFwAdapt::cascadedTrigger(uint32_t cmd, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_triggerCasc->setVal(cmd?1:0));
 }
 
 void CATCACommonFwAdapt::hardwareAutoRearm(uint32_t cmd, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_autoRearm->setVal(cmd?1:0));
 }
 
 void CATCACommonFwAdapt::daqMode(uint32_t cmd, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_daqMode->setVal(cmd?1:0));
 }
 
+void CATCACommonFwAdapt::getDaqMode(uint32_t *val, int index)
+{
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
+    CPSW_TRY_CATCH((_daqMux+index)->_daqMode->getVal(val));
+}
+
 void CATCACommonFwAdapt::enablePacketHeader(uint32_t cmd, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_packetHeader->setVal(cmd?1:0));
 }
 
 void CATCACommonFwAdapt::enableHardwareFreeze(uint32_t cmd, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_freezeHwMask->setVal(cmd?1:0));
 }
 
 void CATCACommonFwAdapt::decimationRateDivisor(uint32_t div, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_decimationRateDiv->setVal(div));
 }
 
 void CATCACommonFwAdapt::dataBufferSize(uint32_t size, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_bufferSize->setVal(size));
 }
 
 void CATCACommonFwAdapt::getTimestamp(uint32_t *sec, uint32_t *nsec, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         (_daqMux+index)->_timestamp[0]->getVal(sec);
         (_daqMux+index)->_timestamp[1]->getVal(nsec);
@@ -557,33 +747,63 @@ void CATCACommonFwAdapt::getTimestamp(uint32_t *sec, uint32_t *nsec, int index)
 
 void CATCACommonFwAdapt::getTriggerCount(uint32_t *count, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_triggerCnt->getVal(count));
 }
 
+void CATCACommonFwAdapt::getAcquisition(uint32_t *sec, uint32_t *nsec, uint32_t *trigCount, int index)
+{
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
+    uint32_t after;
+
+    try {
+        (_daqMux+index)->_triggerCnt->getVal(&after);
+        for(int i = 0; i < ACQUISITION_READ_RETRY; i++) {
+            *trigCount = after;
+            (_daqMux+index)->_timestamp[0]->getVal(sec);
+            (_daqMux+index)->_timestamp[1]->getVal(nsec);
+            (_daqMux+index)->_triggerCnt->getVal(&after);
+            if(after == *trigCount)
+                return;
+        }
+    } catch (CPSWError &e) {
+        fprintf(stderr,"CPSW Error: %s at %s, line %d\n",
+                        e.getInfo().c_str(),
+                        __FILE__, __LINE__);
+        throw e;
+    }
+    fprintf(stderr, "IATCACommonFw: DaqMux%d triggers faster than Timestamp can be read\n", index);
+}
+
 
 void CATCACommonFwAdapt::dbgInputValid(uint32_t *val, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_dbgInputValid->getVal(val));
 }
 
 void CATCACommonFwAdapt::dbgLinkReady(uint32_t *val, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_dbgLinkReady->getVal(val));
 }
 
 
 void CATCACommonFwAdapt::inputMuxSelect(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_inputMuxSel[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::getStreamPause(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_streamPause[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getStreamPause(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_streamPause[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -596,11 +816,13 @@ void CATCACommonFwAdapt::getStreamPause(uint32_t *vals, int index)
 
 void CATCACommonFwAdapt::getStreamReady(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_streamReady[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getStreamReady(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_streamReady[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -614,11 +836,13 @@ void CATCACommonFwAdapt::getStreamReady(uint32_t *vals, int index)
 
 void CATCACommonFwAdapt::getStreamOverflow(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_streamOverflow[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getStreamOverflow(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_streamOverflow[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -631,11 +855,13 @@ void CATCACommonFwAdapt::getStreamOverflow(uint32_t *vals, int index)
 
 void CATCACommonFwAdapt::getStreamError(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_streamError[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getStreamError(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_streamError[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -648,11 +874,13 @@ void CATCACommonFwAdapt::getStreamError(uint32_t *vals, int index)
 
 void CATCACommonFwAdapt::getInputDataValid(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_inputDataValid[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getInputDataValid(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_inputDataValid[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -665,11 +893,13 @@ void CATCACommonFwAdapt::getInputDataValid(uint32_t *vals, int index)
 
 void CATCACommonFwAdapt::getStreamEnabled(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_streamEnabled[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getStreamEnabled(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_streamEnabled[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -682,11 +912,13 @@ void CATCACommonFwAdapt::getStreamEnabled(uint32_t *vals, int index)
 
 void CATCACommonFwAdapt::getFrameCount(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_frameCnt[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getFrameCount(uint32_t *vals, int index)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     try {
         for(int i = 0; i < 4; i++) (_daqMux+index)->_frameCnt[i]->getVal(vals + i);
     } catch (CPSWError &e) {
@@ -697,79 +929,140 @@ void CATCACommonFwAdapt::getFrameCount(uint32_t *vals, int index)
     }
 }
 
+/* only sends the requests, the lock is not held while they are in flight */
+void CATCACommonFwAdapt::getDaqMuxStatus(RegisterBatch batch, daqmux_status_t *status, int index)
+{
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
+
+    batch->get((_daqMux+index)->_triggerCnt,    &status->trigCount);
+    batch->get((_daqMux+index)->_timestamp[0],  &status->timestampSec);
+    batch->get((_daqMux+index)->_timestamp[1],  &status->timestampNsec);
+    batch->get((_daqMux+index)->_dbgInputValid, &status->dbgInputValid);
+    batch->get((_daqMux+index)->_dbgLinkReady,  &status->dbgLinkReady);
+    for(int i = 0; i < STREAMS_PER_DAQMUX; i++) {
+        batch->get((_daqMux+index)->_streamPause[i],    status->streamPause + i);
+        batch->get((_daqMux+index)->_streamReady[i],    status->streamReady + i);
+        batch->get((_daqMux+index)->_streamOverflow[i], status->streamOverflow + i);
+        batch->get((_daqMux+index)->_streamError[i],    status->streamError + i);
+        batch->get((_daqMux+index)->_inputDataValid[i], status->inputDataValid + i);
+        batch->get((_daqMux+index)->_streamEnabled[i],  status->streamEnabled + i);
+        batch->get((_daqMux+index)->_frameCnt[i],       status->frameCnt + i);
+    }
+}
+
 void CATCACommonFwAdapt::formatSignWidth(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_formatSignWidth[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::formatDataWidth(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_formatDataWidth[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::enableFormatSign(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_formatSign[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::enableDecimationAvg(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_daqMuxLock[index]);
     CPSW_TRY_CATCH((_daqMux+index)->_decimation[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::getWfEngineStartAddr(uint64_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
    CPSW_TRY_CATCH((_waveformEngine+index)->_startAddr[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getWfEngineEndAddr(uint64_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_endAddr[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getWfEngineWrAddr(uint64_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_wrAddr[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::getWfEngineStatus(uint32_t *val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_status[chn]->getVal(val));
 }
 
 void CATCACommonFwAdapt::setWfEngineStartAddr(uint64_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_startAddr[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::setWfEngineEndAddr(uint64_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_endAddr[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::enableWfEngine(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_enabled[chn]->setVal(val?1:0));
 }
 
 void CATCACommonFwAdapt::setWfEngineMode(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_mode[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::setWfEngineMsgDest(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_msgDest[chn]->setVal(val));
 }
 
 void CATCACommonFwAdapt::setWfEngineFramesAfterTrigger(uint32_t val, int index, int chn)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_framesAfterTrigger[chn]->setVal(val));
 }
 
 
+/* only sends the requests, the lock is not held while they are in flight */
+void CATCACommonFwAdapt::getWfEngineStatus(RegisterBatch batch, wfe_status_t *status, int index)
+{
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
+
+    for(int j = 0; j < WFE_CHANNEL_CNT; j++) {
+        batch->get((_waveformEngine+index)->_startAddr[j], status->startAddr + j);
+        batch->get((_waveformEngine+index)->_endAddr[j],   status->endAddr + j);
+        batch->get((_waveformEngine+index)->_wrAddr[j],    status->wrAddr + j);
+        batch->get((_waveformEngine+index)->_status[j],    status->status + j);
+    }
+}
+
+/* same order as configureWaveformEngine() */
+void CATCACommonFwAdapt::setWfEngineConfig(RegisterBatch batch, const wfe_config_t *config, int index, int chn)
+{
+    batch->set((_waveformEngine+index)->_startAddr[chn],          config->startAddr);
+    batch->set((_waveformEngine+index)->_endAddr[chn],            config->endAddr);
+    batch->set((_waveformEngine+index)->_framesAfterTrigger[chn], config->framesAfterTrigger);
+    batch->set((_waveformEngine+index)->_enabled[chn],            config->enable ? WFEEnable : WFEDisable);
+    batch->set((_waveformEngine+index)->_mode[chn],               config->mode);
+    batch->set((_waveformEngine+index)->_msgDest[chn],            config->msgDest);
+}
+
+
 void CATCACommonFwAdapt::initWfEngine(int index)
 {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
     CPSW_TRY_CATCH((_waveformEngine+index)->_initialize->execute());
 }
 
@@ -789,7 +1082,17 @@ dram_region_size_t CATCACommonFwAdapt::getAllocableSize(unsigned sizeInBytes)
 
 int CATCACommonFwAdapt::setupWaveformEngine(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize)
 {
-    uint32_t framesAfterTriggerVal = 0;
+    return configureWaveformEngine(waveformEngineIndex, sizeInBytes, ramAllocatedSize, WFEModeDoneWhenFull, 0);
+}
+
+int CATCACommonFwAdapt::setupWaveformEngineWrap(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize, uint32_t framesAfterTrigger)
+{
+    return configureWaveformEngine(waveformEngineIndex, sizeInBytes, ramAllocatedSize, WFEModeWrap, framesAfterTrigger);
+}
+
+int CATCACommonFwAdapt::configureWaveformEngine(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize,
+                                                uint32_t mode, uint32_t framesAfterTriggerVal)
+{
     uint64_t start;
     uint64_t step;
     uint64_t memoryPerWaveformEngine, waveFormEngineBase, totalMemoryAllocated;
@@ -825,12 +1128,14 @@ int CATCACommonFwAdapt::setupWaveformEngine(unsigned waveformEngineIndex, uint64
     if (waveformEngineIndex != 0 && waveformEngineIndex != 1)
         return -1;
 
-    for(int j = 0; j < 4; j++) {
+    std::lock_guard<std::mutex> lock(_waveformEngineLock[waveformEngineIndex]);
+
+    for(int j = 0; j < WFE_CHANNEL_CNT; j++) {
         CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_startAddr[j]->setVal(start));
         CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_endAddr[j]->setVal(start + sizeInBytes));
         CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_framesAfterTrigger[j]->setVal(framesAfterTriggerVal));
         CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_enabled[j]->setVal(WFEEnable));
-        CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_mode[j]->setVal(WFEModeDoneWhenFull)); 
+        CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_mode[j]->setVal(mode)); 
         CPSW_TRY_CATCH((_waveformEngine+waveformEngineIndex)->_msgDest[j]->setVal(WFEMsgDstAutoReadOut));
 
         start += step;
@@ -845,10 +1150,174 @@ void CATCACommonFwAdapt::setupDaqMux(unsigned daqMuxIndex)
     if (daqMuxIndex != 0 && daqMuxIndex != 1)
         return;
 
+    std::lock_guard<std::mutex> daqMuxLock(_daqMuxLock[daqMuxIndex]);
+    std::lock_guard<std::mutex> waveformEngineLock(_waveformEngineLock[daqMuxIndex]);
     CPSW_TRY_CATCH((_daqMux+daqMuxIndex)->_clearTrigStatus->execute());
     CPSW_TRY_CATCH((_daqMux+daqMuxIndex)->_daqMode->setVal(DMTriggerMode));
     CPSW_TRY_CATCH((_daqMux+daqMuxIndex)->_freezeHwMask->setVal(DMHWFreezeDisable));
     CPSW_TRY_CATCH((_waveformEngine+daqMuxIndex)->_initialize->execute());
     CPSW_TRY_CATCH((_daqMux+daqMuxIndex)->_packetHeader->setVal(true?1:0));
 
-}
\ No newline at end of file
+}
+
+void CATCACommonFwAdapt::getWfEngineRing(wfe_ring_t *ring, int index, int chn)
+{
+    uint32_t status;
+
+    {
+        std::lock_guard<std::mutex> lock(_waveformEngineLock[index]);
+        try {
+            (_waveformEngine+index)->_startAddr[chn]->getVal(&ring->start);
+            (_waveformEngine+index)->_endAddr[chn]->getVal(&ring->end);
+            (_waveformEngine+index)->_wrAddr[chn]->getVal(&ring->wrAddr);
+            (_waveformEngine+index)->_status[chn]->getVal(&status);
+        } catch (CPSWError &e) {
+            fprintf(stderr,"CPSW Error: %s at %s, line %d\n",
+                            e.getInfo().c_str(),
+                            __FILE__, __LINE__);
+            throw e;
+        }
+    }
+
+    ring->wrapped = (status & WFE_STATUS_FULL) ? 1 : 0;
+    if(ring->wrAddr < ring->start || ring->wrAddr > ring->end)
+        ring->wrAddr = ring->start;
+
+    if(ring->wrapped) {     /* oldest data right after the write pointer */
+        ring->addr[0] = ring->wrAddr;  ring->size[0] = ring->end    - ring->wrAddr;
+        ring->addr[1] = ring->start;   ring->size[1] = ring->wrAddr - ring->start;
+    } else {
+        ring->addr[0] = ring->start;   ring->size[0] = ring->wrAddr - ring->start;
+        ring->addr[1] = ring->wrAddr;  ring->size[1] = 0;
+    }
+}
+
+void wfeRingSpans(const wfe_ring_t *ring, const uint8_t *region, wfe_span_t spans[2])
+{
+    for(int i = 0; i < 2; i++) {
+        spans[i].data = region + (ring->addr[i] - ring->start);
+        spans[i].size = ring->size[i];
+    }
+}
+
+uint64_t wfeRingCopy(const wfe_ring_t *ring, const uint8_t *region, uint8_t *buf)
+{
+    wfe_span_t spans[2];
+
+    wfeRingSpans(ring, region, spans);
+    memcpy(buf,                 spans[0].data, spans[0].size);
+    memcpy(buf + spans[0].size, spans[1].data, spans[1].size);
+
+    return spans[0].size + spans[1].size;
+}
+
+#define CONFIG_SNAPSHOT_MAGIC    0x41544346   /* "ATCF" */
+
+void CATCACommonFwAdapt::addConfigReg(ScalVal reg, unsigned bytes, std::mutex *lock, int wfe)
+{
+    config_reg_t r;
+
+    r.reg   = reg;
+    r.bytes = bytes;
+    r.lock  = lock;
+    r.wfe   = wfe;
+    _configRegs.push_back(r);
+}
+
+static void putConfigVal(std::vector<uint8_t> *blob, uint64_t val, unsigned bytes)
+{
+    for(unsigned i = 0; i < bytes; i++) blob->push_back((uint8_t) (val >> (8 * i)));
+}
+
+static uint64_t getConfigVal(const uint8_t *p, unsigned bytes)
+{
+    uint64_t val = 0;
+
+    for(unsigned i = 0; i < bytes; i++) val |= (uint64_t) p[i] << (8 * i);
+    return val;
+}
+
+/* Read every register of _configRegs through one batch; vals[i] is valid
+ * if 0 is returned.
+ */
+int CATCACommonFwAdapt::readConfig(std::vector<uint64_t> *vals)
+{
+    RegisterBatch batch = IRegisterBatch::create();
+
+    vals->assign(_configRegs.size(), 0);
+    for(unsigned i = 0; i < _configRegs.size(); i++) {
+        std::lock_guard<std::mutex> lock(*_configRegs[i].lock);
+        batch->get(_configRegs[i].reg, &(*vals)[i]);
+    }
+    return batch->wait();
+}
+
+/* Snapshot layout, little endian:
+ *   uint32_t magic, uint32_t register count,
+ *   then one value per register, 4 or 8 bytes as listed in _configRegs
+ */
+int CATCACommonFwAdapt::saveConfig(std::vector<uint8_t> *blob)
+{
+    std::vector<uint64_t> vals;
+
+    blob->clear();
+    if(readConfig(&vals))
+        return -1;
+
+    putConfigVal(blob, CONFIG_SNAPSHOT_MAGIC, sizeof(uint32_t));
+    putConfigVal(blob, _configRegs.size(),    sizeof(uint32_t));
+    for(unsigned i = 0; i < _configRegs.size(); i++)
+        putConfigVal(blob, vals[i], _configRegs[i].bytes);
+
+    return 0;
+}
+
+/* Write back only the registers whose current value differs from the
+ * snapshot; returns -1 if the snapshot does not match this firmware or
+ * the current values cannot be read.
+ */
+int CATCACommonFwAdapt::restoreConfig(const uint8_t *blob, uint64_t size, unsigned *written)
+{
+    uint64_t              offset = 2 * sizeof(uint32_t);
+    bool                  reinit[MAX_WAVEFORMENGINE_CNT] = { false };
+    std::vector<uint64_t> cur;
+
+    if(written) *written = 0;
+    if(size < offset)
+        return -1;
+    if(getConfigVal(blob, sizeof(uint32_t)) != CONFIG_SNAPSHOT_MAGIC ||
+       getConfigVal(blob + sizeof(uint32_t), sizeof(uint32_t)) != _configRegs.size())
+        return -1;
+
+    for(unsigned i = 0; i < _configRegs.size(); i++)
+        offset += _configRegs[i].bytes;
+    if(offset != size)
+        return -1;
+
+    if(readConfig(&cur))
+        return -1;
+
+    offset = 2 * sizeof(uint32_t);
+    for(unsigned i = 0; i < _configRegs.size(); i++) {
+        config_reg_t *r   = &_configRegs[i];
+        uint64_t      val = getConfigVal(blob + offset, r->bytes);
+
+        offset += r->bytes;
+        if(cur[i] == val)
+            continue;
+
+        std::lock_guard<std::mutex> lock(*r->lock);
+        CPSW_TRY_CATCH(r->reg->setVal(&val));
+        if(written) (*written)++;
+        if(r->wfe >= 0) reinit[r->wfe] = true;
+    }
+
+    for(int i = 0; i < MAX_WAVEFORMENGINE_CNT; i++) {
+        if(!reinit[i])
+            continue;
+        std::lock_guard<std::mutex> lock(_waveformEngineLock[i]);
+        CPSW_TRY_CATCH((_waveformEngine+i)->_initialize->execute());
+    }
+
+    return 0;
+}
@@ -13,6 +13,12 @@
 #include <cpsw_api_user.h>
 #include <cpsw_api_builder.h>
 
+#include <vector>
+
+#include "streamFrame.h"
+#include "debugStream.h"
+#include "registerBatch.h"
+
 typedef enum {
    twogb = 0,
    fourgb,
@@ -20,16 +26,110 @@ typedef enum {
    autogb
 } dram_region_size_t;
 
+#define WFE_STATUS_FULL  (1 << 1)     // waveform engine Status: buffer filled (wrapped in wrap mode)
+
+/* Waveform engine ring after a freeze, in DRAM addresses. addr/size hold
+ * the captured data in chronological order: [0] the oldest part, [1] the
+ * newest part ending just before WrAddr. size[1] is 0 if the ring never
+ * wrapped.
+ */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t wrAddr;
+    uint32_t wrapped;
+    uint64_t addr[2];
+    uint64_t size[2];
+} wfe_ring_t;
+
+typedef struct {
+    const uint8_t *data;
+    uint64_t       size;
+} wfe_span_t;
+
+/* region: host copy of the channel's whole StartAddr..EndAddr buffer, as
+ * read out in DRAM order. wfeRingSpans() points into it without copying,
+ * wfeRingCopy() writes the samples in chronological order to buf.
+ */
+void     wfeRingSpans(const wfe_ring_t *ring, const uint8_t *region, wfe_span_t spans[2]);
+uint64_t wfeRingCopy(const wfe_ring_t *ring, const uint8_t *region, uint8_t *buf);
+
+#define MAX_AMC_CNT        2
+#define MAX_JESD_CNT       6
+#define NUM_JESD           2
+#define WFE_CHANNEL_CNT    4
+
+/* common and JESD registers, as gathered by getCommonStatus() */
+typedef struct {
+    uint32_t upTimeCnt;
+    uint32_t fpgaVersion;
+    uint32_t fpgaTemperature;
+    uint32_t ethUpTimeCnt;
+    uint32_t amcClkFreq[MAX_AMC_CNT];       // register value, getAmcClkFreq() reports twice this; 0 if absent
+    uint32_t jesdCnt[NUM_JESD][MAX_JESD_CNT];
+} common_status_t;
+
+/* waveform engine registers, as gathered by getWfEngineStatus() */
+typedef struct {
+    uint64_t startAddr[WFE_CHANNEL_CNT];
+    uint64_t endAddr[WFE_CHANNEL_CNT];
+    uint64_t wrAddr[WFE_CHANNEL_CNT];
+    uint32_t status[WFE_CHANNEL_CNT];
+} wfe_status_t;
+
+/* setup of one waveform engine channel, as written by setWfEngineConfig() */
+typedef struct {
+    uint64_t startAddr;
+    uint64_t endAddr;
+    uint32_t enable;
+    uint32_t mode;
+    uint32_t msgDest;
+    uint32_t framesAfterTrigger;
+} wfe_config_t;
+
+/* DaqMux status registers, as gathered by getDaqMuxStatus() */
+typedef struct {
+    uint32_t trigCount;
+    uint32_t timestampSec;
+    uint32_t timestampNsec;
+    uint32_t dbgInputValid;
+    uint32_t dbgLinkReady;
+    uint32_t streamPause[STREAMS_PER_DAQMUX];
+    uint32_t streamReady[STREAMS_PER_DAQMUX];
+    uint32_t streamOverflow[STREAMS_PER_DAQMUX];
+    uint32_t streamError[STREAMS_PER_DAQMUX];
+    uint32_t inputDataValid[STREAMS_PER_DAQMUX];
+    uint32_t streamEnabled[STREAMS_PER_DAQMUX];
+    uint32_t frameCnt[STREAMS_PER_DAQMUX];
+} daqmux_status_t;
+
 class IATCACommonFw;
 typedef shared_ptr<IATCACommonFw> ATCACommonFw;
 
-class IATCACommonFw : public virtual IEntry {
+/*
+ * Thread safety:
+ *   Every DaqMux, waveform engine and debug stream is guarded by its own
+ *   lock inside the adapter, so one instance may be shared by several
+ *   threads without external locking. Calls on different DaqMux/waveform
+ *   engine/stream indices run in parallel; calls on the same index are
+ *   serialized. setupDaqMux() holds both the DaqMux and the waveform engine
+ *   of the same index. readStream() holds its stream for the duration of
+ *   the (possibly blocking) read.
+ *
+ * Stream statistics:
+ *   Stream n carries channel n%4 of DaqMux n/4. getStreamStats() and
+ *   getStreamLoss() never wait for a pending readStream() and are cheap
+ *   enough to poll at 1 Hz. Frames still in flight when FrameCnt is read
+ *   show up as lost until they arrive, so look at the trend, not a sample.
+ *
+ * Stream sinks:
+ *   Every frame returned by readStream() is passed to the sinks attached
+ *   to its stream, in the reading thread, before readStream() returns.
+ */
+class IATCACommonFw : public virtual IEntry, public virtual IATCADebugStream {
 public:
     static ATCACommonFw create(Path p);
-    // debug streams
-    virtual void createStreams(ConstPath p, const char *prefix)     = 0;
-    virtual int64_t readStream(uint32_t index, uint8_t *buf, uint64_t size, CTimeout timeout) = 0;
-    //
+    // debug streams: see IATCADebugStream
 
     virtual void getUpTimeCnt(uint32_t *cnt)             = 0;
     virtual void getBuildStamp(uint8_t *str)             = 0;
@@ -39,6 +139,8 @@ public:
     virtual void getGitHash(uint8_t *str)                = 0;
     virtual void getJesdCnt(uint32_t *cnt, int i, int j) = 0;
     virtual void getAmcClkFreq(uint32_t *freq, int i)    = 0;
+    // queue reads of the common and JESD counters above, except the strings; valid after batch->wait()
+    virtual void getCommonStatus(RegisterBatch batch, common_status_t *status) = 0;
     
     // DaqMux Commands
     virtual void triggerDaq(int index)                   = 0;
@@ -49,12 +151,17 @@ public:
     virtual void cascadedTrigger(uint32_t cmd, int index)    = 0;
     virtual void hardwareAutoRearm(uint32_t cmd, int index)  = 0;
     virtual void daqMode(uint32_t cmd, int index)            = 0;
+    virtual void getDaqMode(uint32_t *val, int index)        = 0;
     virtual void enablePacketHeader(uint32_t cmd, int index) = 0;
     virtual void enableHardwareFreeze(uint32_t cmd, int index) = 0;
     virtual void decimationRateDivisor(uint32_t div, int index) = 0;
     virtual void dataBufferSize(uint32_t size, int index)       = 0;
     virtual void getTimestamp(uint32_t *sec, uint32_t *nsec, int index) = 0;
     virtual void getTriggerCount(uint32_t *val, int index) = 0;
+    /* Timestamp and TrigCount of the same acquisition; TrigCount is read
+     * before and after the timestamp and the read repeated if a trigger
+     * came in between */
+    virtual void getAcquisition(uint32_t *sec, uint32_t *nsec, uint32_t *trigCount, int index) = 0;
     virtual void dbgInputValid(uint32_t *val, int index)   = 0;
     virtual void dbgLinkReady(uint32_t *val, int index)    = 0;
     virtual void inputMuxSelect(uint32_t val, int index, int chn) = 0;
@@ -72,6 +179,8 @@ public:
     virtual void getStreamEnabled(uint32_t *vals, int index)          = 0;
     virtual void getFrameCount(uint32_t *val, int index, int chn)     = 0;
     virtual void getFrameCount(uint32_t *val, int index)              = 0;
+    // queue reads of every status register above into batch; valid after batch->wait()
+    virtual void getDaqMuxStatus(RegisterBatch batch, daqmux_status_t *status, int index) = 0;
     virtual void formatSignWidth(uint32_t val, int index, int chn)    = 0;
     virtual void formatDataWidth(uint32_t val, int index, int chn)    = 0;
     virtual void enableFormatSign(uint32_t val, int index, int chn)   = 0;
@@ -88,11 +197,24 @@ public:
     virtual void setWfEngineMode(uint32_t val, int index, int chn) = 0;
     virtual void setWfEngineMsgDest(uint32_t val, int index, int chn) = 0;
     virtual void setWfEngineFramesAfterTrigger(uint32_t val, int index, int chn) = 0;
+    // queue reads of all waveform engine channels; valid after batch->wait()
+    virtual void getWfEngineStatus(RegisterBatch batch, wfe_status_t *status, int index) = 0;
+    // queue the writes of one channel's setup; they go out on batch->submit(), without
+    // the waveform engine lock, and take effect after initWfEngine()
+    virtual void setWfEngineConfig(RegisterBatch batch, const wfe_config_t *config, int index, int chn) = 0;
 
     virtual void initWfEngine(int index) = 0;
     virtual int  setupWaveformEngine(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize) = 0;
+    // rolling pre-trigger capture: WFEModeWrap, stops framesAfterTrigger frames after the trigger
+    virtual int  setupWaveformEngineWrap(unsigned waveformEngineIndex, uint64_t sizeInBytes, dram_region_size_t ramAllocatedSize, uint32_t framesAfterTrigger) = 0;
+    virtual void getWfEngineRing(wfe_ring_t *ring, int index, int chn) = 0;
     virtual dram_region_size_t getAllocableSize(unsigned sizeInBytes) = 0;
     virtual void setupDaqMux(unsigned daqMuxIndex) = 0;
+
+    // configuration snapshot of every writable DaqMux and waveform engine register,
+    // read back in one register batch; return -1 if a register cannot be read
+    virtual int  saveConfig(std::vector<uint8_t> *blob) = 0;
+    virtual int  restoreConfig(const uint8_t *blob, uint64_t size, unsigned *written) = 0;
 };
 
 #endif /* _ATCA_COMMON_FW_H */
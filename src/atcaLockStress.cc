@@ -0,0 +1,303 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+/* Lock contention stress test: threads scanning different DaqMuxes and
+ * polling different waveform engines through one shared IATCACommonFw,
+ * once relying on the adapter's own locks and once behind a single
+ * global mutex the way IOCs used to wrap the adapter. Without a carrier
+ * the registers live in a CPSW MemDev.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "atcaCommon.h"
+
+#define WORKER_KINDS  4       // DaqMux 0, DaqMux 1, waveform engine 0, waveform engine 1
+
+/* just the registers the adapter looks up, backed by memory */
+static const char *stubYaml = R"(
+root:
+  class: MemDev
+  size: 0x100000
+  children:
+    mmio:
+      class: MMIODev
+      size: 0x100000
+      at: {offset: 0}
+      children:
+        AmcCarrierCore:
+          class: MMIODev
+          size: 0x80000
+          at: {offset: 0}
+          children:
+            AxiVersion:
+              class: MMIODev
+              size: 0x1000
+              at: {offset: 0x0000}
+              children:
+                FpgaVersion: {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x000}}
+                UpTimeCnt:   {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x008}}
+                GitHash:     {class: IntField, sizeBits: 8,  mode: RO, at: {offset: 0x600, nelms: 20, stride: 1}}
+                BuildStamp:  {class: IntField, sizeBits: 8,  mode: RO, at: {offset: 0x800, nelms: 256, stride: 1}}
+            AxiSysMonUltraScale:
+              class: MMIODev
+              size: 0x1000
+              at: {offset: 0x1000}
+              children:
+                Temperature: {class: IntField, sizeBits: 16, mode: RO, at: {offset: 0x400}}
+            AmcCarrierBsi:
+              class: MMIODev
+              size: 0x1000
+              at: {offset: 0x2000}
+              children:
+                EthUpTime:   {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x000}}
+            AmcCarrierBsa:
+              class: MMIODev
+              size: 0x10000
+              at: {offset: 0x10000}
+              children:
+                BsaWaveformEngine:
+                  class: MMIODev
+                  size: 0x2000
+                  at: {offset: 0, nelms: 2, stride: 0x2000}
+                  children:
+                    WaveformEngineBuffers:
+                      class: MMIODev
+                      size: 0x1000
+                      at: {offset: 0}
+                      children:
+                        Enabled:            {class: IntField, sizeBits: 32, at: {offset: 0x000, nelms: 4, stride: 4}}
+                        Mode:               {class: IntField, sizeBits: 32, at: {offset: 0x010, nelms: 4, stride: 4}}
+                        MsgDest:            {class: IntField, sizeBits: 32, at: {offset: 0x020, nelms: 4, stride: 4}}
+                        FramesAfterTrigger: {class: IntField, sizeBits: 32, at: {offset: 0x030, nelms: 4, stride: 4}}
+                        Status:             {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x040, nelms: 4, stride: 4}}
+                        Init:               {class: IntField, sizeBits: 32, at: {offset: 0x050}}
+                        StartAddr:          {class: IntField, sizeBits: 64, at: {offset: 0x100, nelms: 4, stride: 8}}
+                        EndAddr:            {class: IntField, sizeBits: 64, at: {offset: 0x120, nelms: 4, stride: 8}}
+                        WrAddr:             {class: IntField, sizeBits: 64, mode: RO, at: {offset: 0x140, nelms: 4, stride: 8}}
+                        Initialize:         {class: SequenceCommand, at: {nelms: 1}, sequence: [{entry: Init, value: 1}]}
+        AppTop:
+          class: MMIODev
+          size: 0x80000
+          at: {offset: 0x80000}
+          children:
+            AppTopJesd:
+              class: MMIODev
+              size: 0x1000
+              at: {offset: 0, nelms: 2, stride: 0x1000}
+              children:
+                JesdRx:
+                  class: MMIODev
+                  size: 0x1000
+                  at: {offset: 0}
+                  children:
+                    StatusValidCnt: {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x100, nelms: 6, stride: 4}}
+            DaqMuxV2:
+              class: MMIODev
+              size: 0x1000
+              at: {offset: 0x10000, nelms: 2, stride: 0x1000}
+              children:
+                Commands:            {class: IntField, sizeBits: 32, at: {offset: 0x000}}
+                TriggerCascMask:     {class: IntField, sizeBits: 32, at: {offset: 0x004}}
+                TriggerHwAutoRearm:  {class: IntField, sizeBits: 32, at: {offset: 0x008}}
+                DaqMode:             {class: IntField, sizeBits: 32, at: {offset: 0x00c}}
+                PacketHeaderEn:      {class: IntField, sizeBits: 32, at: {offset: 0x010}}
+                FreezeHwMask:        {class: IntField, sizeBits: 32, at: {offset: 0x014}}
+                DecimationRateDiv:   {class: IntField, sizeBits: 32, at: {offset: 0x018}}
+                DataBufferSize:      {class: IntField, sizeBits: 32, at: {offset: 0x01c}}
+                Timestamp:           {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x020, nelms: 2, stride: 4}}
+                TrigCount:           {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x028}}
+                DbgInputValid:       {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x02c}}
+                DbgLinkReady:        {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x030}}
+                InputMuxSel:         {class: IntField, sizeBits: 32, at: {offset: 0x040, nelms: 4, stride: 4}}
+                StreamPause:         {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x080, nelms: 4, stride: 4}}
+                StreamReady:         {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x090, nelms: 4, stride: 4}}
+                StreamOverflow:      {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x0a0, nelms: 4, stride: 4}}
+                StreamError:         {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x0b0, nelms: 4, stride: 4}}
+                InputDataValid:      {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x0c0, nelms: 4, stride: 4}}
+                StreamEnabled:       {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x0d0, nelms: 4, stride: 4}}
+                FrameCnt:            {class: IntField, sizeBits: 32, mode: RO, at: {offset: 0x0e0, nelms: 4, stride: 4}}
+                FormatSignWidth:     {class: IntField, sizeBits: 32, at: {offset: 0x100, nelms: 4, stride: 4}}
+                FormatDataWidth:     {class: IntField, sizeBits: 32, at: {offset: 0x110, nelms: 4, stride: 4}}
+                FormatSign:          {class: IntField, sizeBits: 32, at: {offset: 0x120, nelms: 4, stride: 4}}
+                DecimationAveraging: {class: IntField, sizeBits: 32, at: {offset: 0x130, nelms: 4, stride: 4}}
+                TriggerDaq:          {class: SequenceCommand, at: {nelms: 1}, sequence: [{entry: Commands, value: 1}]}
+                ArmHwTrigger:        {class: SequenceCommand, at: {nelms: 1}, sequence: [{entry: Commands, value: 2}]}
+                FreezeBuffers:       {class: SequenceCommand, at: {nelms: 1}, sequence: [{entry: Commands, value: 4}]}
+                ClearTrigStatus:     {class: SequenceCommand, at: {nelms: 1}, sequence: [{entry: Commands, value: 8}]}
+)";
+
+typedef struct {
+    int       kind;           // 0/1: scan DaqMux kind, 2/3: poll waveform engine kind - 2
+    int       chn;            // waveform engine channel owned by this thread
+    uint64_t  calls;
+    uint64_t  mismatches;     // read back differs from what this thread wrote
+    uint64_t  errors;
+} worker_t;
+
+static std::mutex        globalLock;
+static std::atomic<bool> run;
+
+#define CALL(global, X) do {                                \
+        if(global) { std::lock_guard<std::mutex> g(globalLock); X; } \
+        else       { X; }                                   \
+    } while(0)
+
+static void scanDaqMux(ATCACommonFw fw, worker_t *w, bool global)
+{
+    int      index = w->kind;
+    uint32_t val, sec, nsec, vals[STREAMS_PER_DAQMUX];
+
+    for(uint32_t n = 1; run; n++) {
+        try {
+            CALL(global, fw->getTriggerCount(&val, index));
+            CALL(global, fw->getTimestamp(&sec, &nsec, index));
+            CALL(global, fw->getStreamPause(vals, index));
+            CALL(global, fw->getFrameCount(vals, index));
+            CALL(global, fw->decimationRateDivisor(n & 0xff, index));
+            w->calls += 5;
+        } catch (CPSWError &e) {
+            w->errors++;
+        }
+    }
+}
+
+static void pollWaveformEngine(ATCACommonFw fw, worker_t *w, bool global)
+{
+    int      index = w->kind - 2;
+    uint64_t readBack, wrAddr;
+    uint32_t status;
+
+    for(uint64_t n = 1; run; n++) {
+        uint64_t end = ((uint64_t) index << 40) | ((uint64_t) w->chn << 32) | (n & 0xffffffff);
+        try {
+            CALL(global, fw->setWfEngineEndAddr(end, index, w->chn));
+            CALL(global, fw->getWfEngineEndAddr(&readBack, index, w->chn));
+            CALL(global, fw->getWfEngineStatus(&status, index, w->chn));
+            CALL(global, fw->getWfEngineWrAddr(&wrAddr, index, w->chn));
+            w->calls += 4;
+        } catch (CPSWError &e) {
+            w->errors++;
+            continue;
+        }
+        if(readBack != end) w->mismatches++;
+    }
+}
+
+/* returns the aggregate calls per second */
+static double runPhase(ATCACommonFw fw, int threads, bool global, double seconds, uint64_t *mismatches, uint64_t *errors)
+{
+    std::vector<worker_t>    workers(threads);
+    std::vector<std::thread> pool;
+
+    run = true;
+    for(int i = 0; i < threads; i++) {
+        worker_t *w = &workers[i];
+        w->kind       = i % WORKER_KINDS;
+        w->chn        = (i / WORKER_KINDS) % 4;
+        w->calls      = 0;
+        w->mismatches = 0;
+        w->errors     = 0;
+        if(w->kind < 2) pool.push_back(std::thread(scanDaqMux, fw, w, global));
+        else            pool.push_back(std::thread(pollWaveformEngine, fw, w, global));
+    }
+
+    uint64_t start = streamMonotonicTime();
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t) (seconds * 1.e6)));
+    run = false;
+    for(unsigned i = 0; i < pool.size(); i++) pool[i].join();
+    double elapsed = (streamMonotonicTime() - start) * 1.e-9;
+
+    uint64_t calls = 0;
+    for(int i = 0; i < threads; i++) {
+        calls       += workers[i].calls;
+        *mismatches += workers[i].mismatches;
+        *errors     += workers[i].errors;
+    }
+    return calls / elapsed;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -Y yaml       top level YAML file of a carrier (default: registers in memory)\n"
+            "  -r root       root device in the YAML file (default NetIODev)\n"
+            "  -m path       path of the common firmware below the root (default mmio)\n"
+            "  -n threads    maximum number of threads (default 4)\n"
+            "  -t seconds    duration of each run (default 2)\n"
+            "threads alternate between DaqMux 0, DaqMux 1, waveform engine 0 and 1\n"
+            "exit status 1 if a thread read back a value it did not write\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char   *yaml = NULL, *rootName = "NetIODev", *fwPath = "mmio";
+    int           maxThreads = WORKER_KINDS;
+    double        seconds = 2.;
+    ATCACommonFw  fw;
+    int           opt;
+
+    while((opt = getopt(argc, argv, "Y:r:m:n:t:h")) > 0) {
+        switch(opt) {
+            case 'Y': yaml       = optarg;       break;
+            case 'r': rootName   = optarg;       break;
+            case 'm': fwPath     = optarg;       break;
+            case 'n': maxThreads = atoi(optarg); break;
+            case 't': seconds    = atof(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(maxThreads < 1 || maxThreads > 4 * WORKER_KINDS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        Path root;
+        if(yaml) {
+            root = IYamlSupport::buildHierarchy(yaml, rootName);
+        } else {
+            std::istringstream stub(stubYaml);
+            root = IPath::loadYamlStream(stub, "root");
+        }
+        fw = IATCACommonFw::create(root->findByName(fwPath));
+    } catch (CPSWError &e) {
+        fprintf(stderr, "%s: cannot set up the device (%s)\n", argv[0], e.getInfo().c_str());
+        return 1;
+    }
+
+    uint64_t mismatches = 0, errors = 0;
+
+    printf("threads  locking      calls/s  scaling\n");
+    for(int global = 0; global < 2; global++) {
+        double single = 0.;
+        for(int n = 1; n <= maxThreads; n++) {
+            double rate = runPhase(fw, n, global, seconds, &mismatches, &errors);
+            if(n == 1) single = rate;
+            printf("%7d  %-8s %11.0f  %7.2f\n", n, global ? "global" : "adapter", rate, single ? rate / single : 0.);
+            fflush(stdout);
+        }
+    }
+
+    printf("\n%llu read back mismatches, %llu CPSW errors\n",
+           (unsigned long long) mismatches, (unsigned long long) errors);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,337 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+/* Streaming soak test: run the DaqMuxes in continuous mode, read all
+ * streams for a while and report throughput, CPU cost, loss and reader
+ * latency. A stream capture file can stand in for the carrier.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <mutex>
+
+#include "atcaCommon.h"
+#include "streamReader.h"
+#include "streamReplay.h"
+
+#define DAQ_MODE_TRIGGER    0
+#define DAQ_MODE_CONTINUOUS 1
+
+#define DRAIN_QUIET         200000      // [us] without a frame before the streams count as drained
+#define DRAIN_TIMEOUT       5000000     // [us]
+
+static volatile sig_atomic_t stopRequest = 0;
+
+static void onSignal(int)
+{
+    stopRequest = 1;
+}
+
+/* wait until the frames in flight were read */
+static void drainStreams(ATCADebugStream stream, uint32_t mask)
+{
+    uint64_t last = ~0ULL, waited = 0;
+
+    while(waited < DRAIN_TIMEOUT) {
+        uint64_t frames = 0;
+        for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+            stream_stats_t stats;
+            if(!(mask & (1 << i)))
+                continue;
+            stream->getStreamStats(&stats, i);
+            frames += stats.frames;
+        }
+        if(frames == last)
+            return;
+        last = frames;
+        usleep(DRAIN_QUIET);
+        waited += DRAIN_QUIET;
+    }
+    fprintf(stderr, "streams still busy after %.1f s, the loss includes frames in flight\n", DRAIN_TIMEOUT * 1.e-6);
+}
+
+/* time between consecutive frames of a stream, to catch stalls */
+class CFrameIntervalSink : public IStreamFrameSink {
+    protected:
+        std::mutex         _lock;
+        uint64_t           _last;
+        CLatencyHistogram  _interval;
+
+    public:
+        CFrameIntervalSink() : _last(0) {}
+
+        virtual void processFrame(const stream_frame_t *frame)
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            if(_last && frame->arrivalTime > _last) _interval.add(frame->arrivalTime - _last);
+            _last = frame->arrivalTime;
+        }
+
+        void getReport(latency_report_t *report)
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _interval.getReport(report);
+        }
+};
+
+static double cpuSeconds(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1.e-6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1.e-6;
+}
+
+static void printLatency(const char *name, const latency_report_t *r)
+{
+    if(!r->count)
+        return;
+    printf("    %-10s n %-10llu p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n", name,
+           (unsigned long long) r->count, r->p50 * 1.e-3, r->p99 * 1.e-3, r->p999 * 1.e-3, r->max * 1.e-3);
+}
+
+static int parseCpuList(const char *list, int cpu[MAX_DEBUG_STREAM])
+{
+    char *end;
+    int   n = 0;
+
+    while(*list && n < MAX_DEBUG_STREAM) {
+        cpu[n++] = strtol(list, &end, 0);
+        if(end == list || (*end && *end != ','))
+            return -1;
+        list = *end ? end + 1 : end;
+    }
+    for(int i = n; i < MAX_DEBUG_STREAM; i++) cpu[i] = n ? cpu[i % n] : -1;
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s (-Y <yaml> | -f <capture>) [options]\n"
+            "  -Y yaml       top level YAML file of the carrier\n"
+            "  -r root       root device in the YAML file (default NetIODev)\n"
+            "  -m path       path of the common firmware below the root (default mmio)\n"
+            "  -S format     stream path format below the root (default Stream%%d)\n"
+            "  -f capture    replay a stream capture file instead of hardware\n"
+            "  -x speed      replay speed, 0 = as fast as possible (default 1)\n"
+            "  -t seconds    run time (default 10)\n"
+            "  -s mask       streams to read (default 0xff)\n"
+            "  -b size       DataBufferSize, 0 keeps the firmware value (default 0)\n"
+            "  -M mode       block | poll | spin (default block)\n"
+            "  -c cpus       comma separated cores for the reader threads\n"
+            "  -p priority   SCHED_FIFO priority of the readers (default 0, not RT)\n"
+            "  -w us         spin time before blocking in spin mode (default 100)\n"
+            "  -T us         timeout of blocking reads (default 100000)\n"
+            "  -z bytes      maximum frame size (default 4194304)\n"
+            "  -i seconds    progress report interval (default 1)\n"
+            "exit status 2 if frames were lost\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char             *yaml = NULL, *rootName = "NetIODev", *fwPath = "mmio";
+    const char             *streamFormat = "Stream%d", *capture = NULL;
+    double                  speed = 1., runTime = 10., interval = 1.;
+    uint32_t                bufferSize = 0;
+    stream_reader_config_t  config;
+    ATCACommonFw            fw;
+    ATCADebugStream         stream;
+    StreamReplay            replay;
+    uint32_t                daqMode[MAX_DAQMUX_CNT];
+    uint32_t                daqMuxMask = 0;
+    shared_ptr<CFrameIntervalSink> intervals[MAX_DEBUG_STREAM];
+    int                     opt;
+
+    memset(&config, 0, sizeof(config));
+    config.streamMask   = 0xff;
+    config.mode         = readerBlock;
+    config.spinTime     = 100;
+    config.blockTimeout = 100000;
+    config.maxFrameSize = 4 << 20;
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) config.cpu[i] = -1;
+
+    while((opt = getopt(argc, argv, "Y:r:m:S:f:x:t:s:b:M:c:p:w:T:z:i:h")) > 0) {
+        switch(opt) {
+            case 'Y': yaml         = optarg;                   break;
+            case 'r': rootName     = optarg;                   break;
+            case 'm': fwPath       = optarg;                   break;
+            case 'S': streamFormat = optarg;                   break;
+            case 'f': capture      = optarg;                   break;
+            case 'x': speed        = atof(optarg);             break;
+            case 't': runTime      = atof(optarg);             break;
+            case 's': config.streamMask   = strtoul(optarg, NULL, 0); break;
+            case 'b': bufferSize          = strtoul(optarg, NULL, 0); break;
+            case 'p': config.priority     = atoi(optarg);             break;
+            case 'w': config.spinTime     = strtoul(optarg, NULL, 0); break;
+            case 'T': config.blockTimeout = strtoul(optarg, NULL, 0); break;
+            case 'z': config.maxFrameSize = strtoull(optarg, NULL, 0); break;
+            case 'i': interval     = atof(optarg);             break;
+            case 'M':
+                if(!strcmp(optarg, "block"))      config.mode = readerBlock;
+                else if(!strcmp(optarg, "poll"))  config.mode = readerBusyPoll;
+                else if(!strcmp(optarg, "spin"))  config.mode = readerSpinThenBlock;
+                else { usage(argv[0]); return 1; }
+                break;
+            case 'c':
+                if(parseCpuList(optarg, config.cpu)) { usage(argv[0]); return 1; }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(!yaml == !capture) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        if(capture) {
+            replay = IStreamReplay::create(capture, speed, true);
+            if(!replay)
+                return 1;
+            stream = replay;
+            stream->createStreams(ConstPath(), NULL);
+        } else {
+            Path root = IYamlSupport::buildHierarchy(yaml, rootName);
+            fw     = IATCACommonFw::create(root->findByName(fwPath));
+            stream = fw;
+            for(int i = 0; i < MAX_DAQMUX_CNT; i++) {
+                if(!(config.streamMask & (0xf << (i * STREAMS_PER_DAQMUX))))
+                    continue;
+                fw->getDaqMode(&daqMode[i], i);
+                daqMuxMask |= 1 << i;
+                fw->setupDaqMux(i);
+                if(bufferSize) fw->dataBufferSize(bufferSize, i);
+                fw->daqMode(DAQ_MODE_CONTINUOUS, i);
+            }
+            stream->createStreams(root, streamFormat);
+        }
+    } catch (CPSWError &e) {
+        fprintf(stderr, "%s: cannot set up the device (%s)\n", argv[0], e.getInfo().c_str());
+        return 1;
+    }
+
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        if(!(config.streamMask & (1 << i)))
+            continue;
+        intervals[i] = shared_ptr<CFrameIntervalSink>(new CFrameIntervalSink());
+        stream->addStreamSink(intervals[i], i);
+        stream->resetStreamStats(i);
+    }
+
+    StreamReader reader = IStreamReader::create(stream, &config);
+
+    signal(SIGINT,  onSignal);
+    signal(SIGTERM, onSignal);
+
+    uint64_t start    = streamMonotonicTime();
+    double   cpuStart = cpuSeconds();
+
+    reader->start();
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++)
+        if(daqMuxMask & (1 << i)) fw->triggerDaq(i);
+
+    double elapsed = 0.;
+    while(!stopRequest && elapsed < runTime) {
+        usleep((useconds_t) (interval * 1.e6));
+        elapsed = (streamMonotonicTime() - start) * 1.e-9;
+
+        printf("%8.1f s", elapsed);
+        for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+            stream_stats_t stats;
+            if(!(config.streamMask & (1 << i)))
+                continue;
+            stream->getStreamStats(&stats, i);
+            printf("  s%d %7.1f MB/s", i, stats.bytesPerSec * 1.e-6);
+        }
+        printf("\n");
+        fflush(stdout);
+
+        if(replay && replay->done())
+            break;
+    }
+
+    /* stop the sources, keep reading until the frames in flight arrived,
+     * then take the loss */
+    if(replay)
+        replay->stop();
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++)
+        if(daqMuxMask & (1 << i)) fw->daqMode(DAQ_MODE_TRIGGER, i);
+    drainStreams(stream, config.streamMask);
+
+    elapsed = (streamMonotonicTime() - start) * 1.e-9;
+    double cpu = cpuSeconds() - cpuStart;
+
+    uint64_t totalBytes = 0, totalFrames = 0;
+    int64_t  totalLost  = 0;
+
+    printf("\nstream      frames          bytes      MB/s   lost  ovfl pause\n");
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        stream_stats_t stats;
+        stream_loss_t  loss;
+        if(!(config.streamMask & (1 << i)))
+            continue;
+        stream->getStreamStats(&stats, i);
+        stream->getStreamLoss(&loss, i);
+        printf("%6d %11llu %14llu %9.1f %6lld %5u %5u\n", i,
+               (unsigned long long) stats.frames, (unsigned long long) stats.bytes,
+               stats.bytes / elapsed * 1.e-6, (long long) loss.lostFrames, loss.overflow, loss.pause);
+        totalBytes  += stats.bytes;
+        totalFrames += stats.frames;
+        totalLost   += loss.lostFrames;
+    }
+
+    reader->stop();
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++)
+        if(daqMuxMask & (1 << i)) fw->daqMode(daqMode[i], i);
+
+    printf("\ntotal %llu frames, %.3f GB in %.1f s: %.1f MB/s, %lld frames lost\n",
+           (unsigned long long) totalFrames, totalBytes * 1.e-9, elapsed,
+           totalBytes / elapsed * 1.e-6, (long long) totalLost);
+    printf("cpu %.2f s (%.0f%% of one core), %.2f cpu s/GB\n",
+           cpu, cpu / elapsed * 100., totalBytes ? cpu / (totalBytes * 1.e-9) : 0.);
+
+    /* ready is only known for a replay; on the carrier the reader reports
+     * the blocking read wakeup overshoot and the gap behind an empty poll */
+    printf("\nreader latency\n");
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        stream_reader_stats_t rs;
+        if(!(config.streamMask & (1 << i)))
+            continue;
+        reader->getStats(&rs, i);
+        printf("  stream %d: %llu frames, %llu polled, %llu blocked, %llu read errors\n", i,
+               (unsigned long long) rs.frames, (unsigned long long) rs.polledFrames,
+               (unsigned long long) rs.blockedFrames, (unsigned long long) rs.errors);
+        printLatency("ready",    &rs.latency);
+        printLatency("wakeup",   &rs.wakeup);
+        printLatency("pollGap",  &rs.pollGap);
+    }
+
+    /* spacing of frame arrivals, set by the firmware rate and the reader
+     * jitter; not a latency */
+    printf("\nframe arrival intervals\n");
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        latency_report_t frameInterval;
+        if(!(config.streamMask & (1 << i)))
+            continue;
+        intervals[i]->getReport(&frameInterval);
+        printf("  stream %d:\n", i);
+        printLatency("interval", &frameInterval);
+    }
+
+    return totalLost > 0 ? 2 : 0;
+}
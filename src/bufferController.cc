@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include "bufferController.h"
+
+class CBufferController : public IBufferController {
+    protected:
+        ATCACommonFw              _fw;
+        unsigned                  _daqMuxIndex;
+        buffer_control_config_t   _config;
+        HostQueue                 _queue;
+        std::atomic<uint32_t>     _bufferSize;
+        std::atomic<uint32_t>     _decimation;
+        uint32_t                  _idle;            // consecutive idle periods
+        std::mutex                _lock;
+        std::condition_variable   _cond;
+        std::thread               _thread;
+        bool                      _run;
+
+        void controlLoop();
+        void control();
+        void setBufferSize(uint32_t size, const char *reason);
+        void setDecimation(uint32_t div, const char *reason);
+
+    public:
+        CBufferController(ATCACommonFw fw, unsigned daqMuxIndex, const buffer_control_config_t *config, HostQueue queue);
+        virtual ~CBufferController();
+
+        virtual void     start();
+        virtual void     stop();
+        virtual uint32_t getBufferSize();
+        virtual uint32_t getDecimation();
+};
+
+BufferController IBufferController::create(ATCACommonFw fw, unsigned daqMuxIndex, const buffer_control_config_t *config, HostQueue queue)
+{
+    return BufferController(new CBufferController(fw, daqMuxIndex, config, queue));
+}
+
+CBufferController::CBufferController(ATCACommonFw fw, unsigned daqMuxIndex, const buffer_control_config_t *config, HostQueue queue) :
+    _fw(fw),
+    _daqMuxIndex(daqMuxIndex),
+    _config(*config),
+    _queue(queue),
+    _bufferSize(config->initialBufferSize),
+    _decimation(config->initialDecimation),
+    _idle(0),
+    _run(false)
+{
+}
+
+CBufferController::~CBufferController()
+{
+    stop();
+}
+
+void CBufferController::start()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(_run)
+        return;
+
+    _fw->dataBufferSize(_bufferSize, _daqMuxIndex);
+    if(_config.adjustDecimation) _fw->decimationRateDivisor(_decimation, _daqMuxIndex);
+
+    _run    = true;
+    _thread = std::thread(&CBufferController::controlLoop, this);
+}
+
+void CBufferController::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        if(!_run)
+            return;
+        _run = false;
+        _cond.notify_one();
+    }
+    _thread.join();
+}
+
+uint32_t CBufferController::getBufferSize()
+{
+    return _bufferSize;
+}
+
+uint32_t CBufferController::getDecimation()
+{
+    return _decimation;
+}
+
+void CBufferController::controlLoop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while(_run) {
+        _cond.wait_for(lock, std::chrono::milliseconds(_config.period));
+        if(!_run)
+            break;
+
+        lock.unlock();
+        try {
+            control();
+        } catch (CPSWError &e) {
+            /* already reported by the adapter, try again next period */
+        }
+        lock.lock();
+    }
+}
+
+void CBufferController::setBufferSize(uint32_t size, const char *reason)
+{
+    if(size < _config.minBufferSize) size = _config.minBufferSize;
+    if(size > _config.maxBufferSize) size = _config.maxBufferSize;
+    if(size == _bufferSize)
+        return;
+
+    fprintf(stderr, "IBufferController: DaqMux%u DataBufferSize %u -> %u (%s)\n", _daqMuxIndex, (uint32_t) _bufferSize, size, reason);
+    _fw->dataBufferSize(size, _daqMuxIndex);
+    _bufferSize = size;
+}
+
+void CBufferController::setDecimation(uint32_t div, const char *reason)
+{
+    if(div < _config.minDecimation) div = _config.minDecimation;
+    if(div > _config.maxDecimation) div = _config.maxDecimation;
+    if(div == _decimation)
+        return;
+
+    fprintf(stderr, "IBufferController: DaqMux%u DecimationRateDiv %u -> %u (%s)\n", _daqMuxIndex, (uint32_t) _decimation, div, reason);
+    _fw->decimationRateDivisor(div, _daqMuxIndex);
+    _decimation = div;
+}
+
+void CBufferController::control()
+{
+    uint32_t pause[STREAMS_PER_DAQMUX], overflow[STREAMS_PER_DAQMUX];
+    uint32_t anyPause = 0, anyOverflow = 0;
+    double   fill     = _queue ? _queue->getQueueFill() : 0.;
+
+    _fw->getStreamPause(pause, _daqMuxIndex);
+    _fw->getStreamOverflow(overflow, _daqMuxIndex);
+    for(int i = 0; i < STREAMS_PER_DAQMUX; i++) {
+        anyPause    |= pause[i];
+        anyOverflow |= overflow[i];
+    }
+
+    if(anyOverflow || anyPause || fill > _config.highWater) {
+        const char *reason = anyOverflow ? "stream overflow" : anyPause ? "stream pause" : "host queue full";
+        _idle = 0;
+        if(_bufferSize > _config.minBufferSize)
+            setBufferSize(_bufferSize / 2, reason);
+        else if(_config.adjustDecimation)
+            setDecimation(_decimation ? _decimation * 2 : 1, reason);
+    } else if(fill < _config.lowWater) {
+        if(++_idle < (_config.idlePeriods ? _config.idlePeriods : 1))
+            return;
+        _idle = 0;
+        if(_config.adjustDecimation && _decimation > _config.minDecimation)
+            setDecimation(_decimation / 2, "host idle");
+        else
+            setBufferSize(_config.maxBufferSize - _bufferSize > _config.bufferStep ?
+                          _bufferSize + _config.bufferStep : _config.maxBufferSize, "host idle");
+    } else {
+        _idle = 0;
+    }
+}
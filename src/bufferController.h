@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _BUFFER_CONTROLLER_H
+#define _BUFFER_CONTROLLER_H
+
+#include "atcaCommon.h"
+
+typedef struct {
+    uint32_t  initialBufferSize;    // DataBufferSize applied at start()
+    uint32_t  minBufferSize;
+    uint32_t  maxBufferSize;
+    uint32_t  bufferStep;           // increase per idle step
+    uint32_t  adjustDecimation;     // 0: leave DecimationRateDiv alone
+    uint32_t  initialDecimation;
+    uint32_t  minDecimation;
+    uint32_t  maxDecimation;
+    double    highWater;            // host queue fill (0..1) treated as saturated
+    double    lowWater;             // host queue fill (0..1) treated as idle
+    uint32_t  idlePeriods;          // consecutive idle periods per idle step (0 = 1)
+    uint32_t  period;               // control period [ms]
+} buffer_control_config_t;
+
+class IHostQueue;
+typedef shared_ptr<IHostQueue> HostQueue;
+
+/* Fill level of the host side consumer queue, 0 = empty, 1 = full */
+class IHostQueue {
+public:
+    virtual double getQueueFill() = 0;
+    virtual ~IHostQueue() {}
+};
+
+class IBufferController;
+typedef shared_ptr<IBufferController> BufferController;
+
+/* Closed loop control of DataBufferSize (and optionally DecimationRateDiv)
+ * of one DaqMux.
+ *
+ * Every period the controller reads StreamPause/StreamOverflow of the
+ * four channels and the host queue fill. When the host is saturated
+ * (pause, overflow or fill above highWater) it cuts the data rate at
+ * once: it halves the buffer size and, once at minBufferSize, doubles the
+ * decimation. When the host has been idle (no pause/overflow, fill below
+ * lowWater) for idlePeriods periods in a row it takes one step back: it
+ * first halves the decimation down to minDecimation, then grows the
+ * buffer by bufferStep up to maxBufferSize. Between the water marks it
+ * holds and the idle count restarts, so the loop settles just below
+ * saturation instead of oscillating. Every adjustment is logged to
+ * stderr.
+ */
+class IBufferController {
+public:
+    static BufferController create(ATCACommonFw fw, unsigned daqMuxIndex, const buffer_control_config_t *config, HostQueue queue);
+
+    virtual void     start() = 0;
+    virtual void     stop()  = 0;
+    virtual uint32_t getBufferSize() = 0;
+    virtual uint32_t getDecimation() = 0;
+    virtual ~IBufferController() {}
+};
+
+#endif /* _BUFFER_CONTROLLER_H */
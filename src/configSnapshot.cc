@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#include <vector>
+
+#include "configSnapshot.h"
+
+#define SNAPSHOT_FILE_MAGIC    0x4154534e   /* "ATSN" */
+#define SNAPSHOT_FILE_VERSION  1
+
+/* File layout, little endian throughout: uint32_t magic, uint32_t
+ * version, then the DaqMux/waveform engine section and the crossbar
+ * section, each as uint64_t size + data.
+ */
+
+static int writeVal(FILE *fp, uint64_t val, unsigned bytes)
+{
+    uint8_t buf[sizeof(uint64_t)];
+
+    for(unsigned i = 0; i < bytes; i++) buf[i] = (uint8_t) (val >> (8 * i));
+    return fwrite(buf, bytes, 1, fp) == 1 ? 0 : -1;
+}
+
+static int readVal(FILE *fp, uint64_t *val, unsigned bytes)
+{
+    uint8_t buf[sizeof(uint64_t)];
+
+    if(fread(buf, bytes, 1, fp) != 1)
+        return -1;
+    *val = 0;
+    for(unsigned i = 0; i < bytes; i++) *val |= (uint64_t) buf[i] << (8 * i);
+    return 0;
+}
+
+static int writeSection(FILE *fp, const std::vector<uint8_t> &section)
+{
+    uint64_t size = section.size();
+
+    if(writeVal(fp, size, sizeof(size)))
+        return -1;
+    if(size && fwrite(section.data(), size, 1, fp) != 1)
+        return -1;
+    return 0;
+}
+
+static int readSection(FILE *fp, std::vector<uint8_t> *section)
+{
+    uint64_t size;
+
+    if(readVal(fp, &size, sizeof(size)) || size > (1 << 20))
+        return -1;
+    section->resize(size);
+    if(size && fread(section->data(), size, 1, fp) != 1)
+        return -1;
+    return 0;
+}
+
+int saveConfigSnapshot(const char *fileName, ATCACommonFw fw, CrossbarControl::CrossbarControlYaml *crossbar)
+{
+    std::vector<uint8_t> fwSection, crossbarSection;
+    FILE                *fp;
+    int                  rval = 0;
+
+    if(fw->saveConfig(&fwSection)) {
+        fprintf(stderr, "saveConfigSnapshot: cannot read the firmware configuration\n");
+        return -1;
+    }
+    if(crossbar) crossbar->SaveConfig(&crossbarSection);
+
+    if(!(fp = fopen(fileName, "wb"))) {
+        fprintf(stderr, "saveConfigSnapshot: cannot open %s\n", fileName);
+        return -1;
+    }
+
+    if(writeVal(fp, SNAPSHOT_FILE_MAGIC,   sizeof(uint32_t)) ||
+       writeVal(fp, SNAPSHOT_FILE_VERSION, sizeof(uint32_t)) ||
+       writeSection(fp, fwSection) ||
+       writeSection(fp, crossbarSection))
+        rval = -1;
+
+    if(fclose(fp)) rval = -1;
+    if(rval) fprintf(stderr, "saveConfigSnapshot: error writing %s\n", fileName);
+
+    return rval;
+}
+
+int restoreConfigSnapshot(const char *fileName, ATCACommonFw fw, CrossbarControl::CrossbarControlYaml *crossbar, unsigned *written)
+{
+    uint64_t             head[2];
+    std::vector<uint8_t> fwSection, crossbarSection;
+    unsigned             fwWritten = 0, crossbarWritten = 0;
+    FILE                *fp;
+    int                  rval = 0;
+
+    if(written) *written = 0;
+
+    if(!(fp = fopen(fileName, "rb"))) {
+        fprintf(stderr, "restoreConfigSnapshot: cannot open %s\n", fileName);
+        return -1;
+    }
+
+    if(readVal(fp, &head[0], sizeof(uint32_t)) || readVal(fp, &head[1], sizeof(uint32_t)) ||
+       head[0] != SNAPSHOT_FILE_MAGIC || head[1] != SNAPSHOT_FILE_VERSION ||
+       readSection(fp, &fwSection) ||
+       readSection(fp, &crossbarSection))
+        rval = -1;
+    fclose(fp);
+
+    if(rval) {
+        fprintf(stderr, "restoreConfigSnapshot: %s is not a valid snapshot\n", fileName);
+        return -1;
+    }
+
+    if(fw->restoreConfig(fwSection.data(), fwSection.size(), &fwWritten))
+        return -1;
+    if(crossbar && crossbarSection.size() &&
+       crossbar->RestoreConfig(crossbarSection.data(), crossbarSection.size(), &crossbarWritten))
+        return -1;
+
+    if(written) *written = fwWritten + crossbarWritten;
+    return 0;
+}
@@ -0,0 +1,25 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _CONFIG_SNAPSHOT_H
+#define _CONFIG_SNAPSHOT_H
+
+#include "atcaCommon.h"
+#include "crossbarControlYaml.hh"
+
+/* Warm restart support: save the writable DaqMux, waveform engine and
+ * (optionally) crossbar state to a file, and restore it by writing only
+ * the registers that differ from the hardware. crossbar may be NULL.
+ * Both return 0 on success and -1 on I/O error or a snapshot which does
+ * not match the firmware.
+ */
+int saveConfigSnapshot(const char *fileName, ATCACommonFw fw, CrossbarControl::CrossbarControlYaml *crossbar);
+int restoreConfigSnapshot(const char *fileName, ATCACommonFw fw, CrossbarControl::CrossbarControlYaml *crossbar, unsigned *written);
+
+#endif /* _CONFIG_SNAPSHOT_H */
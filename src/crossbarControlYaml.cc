@@ -87,3 +87,53 @@ void CrossbarControlYaml::SetOutputConfig3(uint32_t output)
     _outputConfig3->setVal(&output);
 }
 
+#define CROSSBAR_SNAPSHOT_MAGIC  0x41544358   /* "ATCX" */
+
+/* Snapshot layout, little endian like the firmware section:
+ * uint32_t magic, OutputConfig[0..3] */
+void CrossbarControlYaml::SaveConfig(std::vector<uint8_t> *blob)
+{
+    uint32_t    val[5];
+
+    val[0] = CROSSBAR_SNAPSHOT_MAGIC;
+    val[1] = GetOutputConfig0();
+    val[2] = GetOutputConfig1();
+    val[3] = GetOutputConfig2();
+    val[4] = GetOutputConfig3();
+
+    blob->clear();
+    for(int i = 0; i < 5; i++)
+        for(int j = 0; j < 4; j++) blob->push_back((uint8_t) (val[i] >> (8 * j)));
+}
+
+/* Write back only the outputs which differ from the snapshot */
+int CrossbarControlYaml::RestoreConfig(const uint8_t *blob, uint64_t size, unsigned *written)
+{
+    uint32_t    val[5];
+    ScalVal     reg[4] = { _outputConfig0, _outputConfig1, _outputConfig2, _outputConfig3 };
+    uint32_t    cur[4];
+
+    if(written) *written = 0;
+    if(size != sizeof(val))
+        return -1;
+    for(int i = 0; i < 5; i++) {
+        val[i] = 0;
+        for(int j = 0; j < 4; j++) val[i] |= (uint32_t) blob[4 * i + j] << (8 * j);
+    }
+    if(val[0] != CROSSBAR_SNAPSHOT_MAGIC)
+        return -1;
+
+    cur[0] = GetOutputConfig0();
+    cur[1] = GetOutputConfig1();
+    cur[2] = GetOutputConfig2();
+    cur[3] = GetOutputConfig3();
+
+    for(int i = 0; i < 4; i++) {
+        if(cur[i] == val[i+1])
+            continue;
+        reg[i]->setVal(&val[i+1]);
+        if(written) (*written)++;
+    }
+
+    return 0;
+}
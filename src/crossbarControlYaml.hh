@@ -30,6 +30,9 @@ namespace CrossbarControl {
             void     SetOutputConfig1(uint32_t output);
             void     SetOutputConfig2(uint32_t output);
             void     SetOutputConfig3(uint32_t output);
+
+            void     SaveConfig(std::vector<uint8_t> *blob);
+            int      RestoreConfig(const uint8_t *blob, uint64_t size, unsigned *written);
             
             
         protected:
@@ -0,0 +1,100 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+
+#include <algorithm>
+
+#include "debugStream.h"
+
+CDebugStreamDispatch::CDebugStreamDispatch()
+{
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) resetStats(i);
+}
+
+void CDebugStreamDispatch::frameDone(uint32_t index, const uint8_t *buf, int64_t got, uint64_t arrivalTime, uint64_t readyTime)
+{
+    stream_frame_t frame;
+
+    {
+        std::lock_guard<std::mutex> lock((_streamStats+index)->_lock);
+        stream_stats_t *s = &(_streamStats+index)->_stats;
+        if(got <= 0) {
+            s->timeouts++;
+            return;
+        }
+
+        int bin = 0;
+        while(bin < STREAM_SIZE_HIST_BINS-1 && ((uint64_t) got >> (bin+1))) bin++;
+
+        s->frames++;
+        s->bytes += got;
+        s->sizeHist[bin]++;
+        if(s->minFrameSize == 0 || (uint64_t) got < s->minFrameSize) s->minFrameSize = got;
+        if((uint64_t) got > s->maxFrameSize)                         s->maxFrameSize = got;
+    }
+
+    frame.stream      = index;
+    frame.data        = buf;
+    frame.size        = got;
+    frame.arrivalTime = arrivalTime;
+    frame.readyTime   = readyTime;
+
+    std::lock_guard<std::mutex> lock((_streamSinks+index)->_lock);
+    for(unsigned i = 0; i < (_streamSinks+index)->_list.size(); i++)
+        (_streamSinks+index)->_list[i]->processFrame(&frame);
+}
+
+void CDebugStreamDispatch::getStats(stream_stats_t *stats, uint32_t index)
+{
+    std::lock_guard<std::mutex> lock((_streamStats+index)->_lock);
+    uint64_t now     = streamMonotonicTime();
+    double   elapsed = (now - (_streamStats+index)->_pollTime) * 1.E-9;
+    stream_stats_t *s = &(_streamStats+index)->_stats;
+
+    if(elapsed > 0.) {
+        s->framesPerSec = (s->frames - (_streamStats+index)->_pollFrames) / elapsed;
+        s->bytesPerSec  = (s->bytes  - (_streamStats+index)->_pollBytes)  / elapsed;
+    }
+    (_streamStats+index)->_pollTime   = now;
+    (_streamStats+index)->_pollFrames = s->frames;
+    (_streamStats+index)->_pollBytes  = s->bytes;
+
+    *stats = *s;
+}
+
+void CDebugStreamDispatch::resetStats(uint32_t index, uint64_t hwFrameBase)
+{
+    std::lock_guard<std::mutex> lock((_streamStats+index)->_lock);
+    memset(&(_streamStats+index)->_stats, 0, sizeof(stream_stats_t));
+    (_streamStats+index)->_pollTime    = streamMonotonicTime();
+    (_streamStats+index)->_pollFrames  = 0;
+    (_streamStats+index)->_pollBytes   = 0;
+    (_streamStats+index)->_hwFrameBase = hwFrameBase;
+}
+
+uint64_t CDebugStreamDispatch::getHostFrames(uint32_t index, uint64_t *hwFrameBase)
+{
+    std::lock_guard<std::mutex> lock((_streamStats+index)->_lock);
+    if(hwFrameBase) *hwFrameBase = (_streamStats+index)->_hwFrameBase;
+    return (_streamStats+index)->_stats.frames;
+}
+
+void CDebugStreamDispatch::addSink(StreamFrameSink sink, uint32_t index)
+{
+    std::lock_guard<std::mutex> lock((_streamSinks+index)->_lock);
+    (_streamSinks+index)->_list.push_back(sink);
+}
+
+void CDebugStreamDispatch::removeSink(StreamFrameSink sink, uint32_t index)
+{
+    std::lock_guard<std::mutex> lock((_streamSinks+index)->_lock);
+    std::vector<StreamFrameSink> *list = &(_streamSinks+index)->_list;
+    list->erase(std::remove(list->begin(), list->end(), sink), list->end());
+}
@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _DEBUG_STREAM_H
+#define _DEBUG_STREAM_H
+
+#include <cpsw_api_user.h>
+
+#include <vector>
+#include <mutex>
+
+#include "streamFrame.h"
+
+#define STREAM_SIZE_HIST_BINS  32
+
+typedef struct {
+    uint64_t frames;          // frames received since the last reset
+    uint64_t bytes;           // bytes received since the last reset
+    uint64_t timeouts;        // reads which returned without data
+    uint64_t minFrameSize;
+    uint64_t maxFrameSize;
+    double   framesPerSec;    // rates since the previous getStreamStats() call
+    double   bytesPerSec;
+    uint64_t sizeHist[STREAM_SIZE_HIST_BINS];  // bin k: 2^k <= size < 2^(k+1)
+} stream_stats_t;
+
+typedef struct {
+    uint32_t hwFrames;        // FrameCnt increment since the last reset
+    uint64_t hostFrames;      // frames received by the host since the last reset
+    int64_t  lostFrames;      // hwFrames - hostFrames: lost between firmware and host
+    uint32_t overflow;        // StreamOverflow: firmware dropped data under backpressure
+    uint32_t pause;           // StreamPause: firmware is being held off by the host
+} stream_loss_t;
+
+class IATCADebugStream;
+typedef shared_ptr<IATCADebugStream> ATCADebugStream;
+
+/* The debug stream part of IATCACommonFw. Stream consumers take an
+ * ATCADebugStream so they run unchanged on hardware or on a replay.
+ */
+class IATCADebugStream {
+public:
+    virtual void createStreams(ConstPath p, const char *prefix)     = 0;
+    virtual int64_t readStream(uint32_t index, uint8_t *buf, uint64_t size, CTimeout timeout) = 0;
+    virtual void getStreamStats(stream_stats_t *stats, uint32_t index) = 0;
+    virtual void getStreamLoss(stream_loss_t *loss, uint32_t index)    = 0;
+    virtual void resetStreamStats(uint32_t index)                      = 0;
+    virtual void getStreamFormat(stream_format_t *format, uint32_t index)  = 0;
+    virtual void addStreamSink(StreamFrameSink sink, uint32_t index)       = 0;
+    virtual void removeStreamSink(StreamFrameSink sink, uint32_t index)    = 0;
+    virtual ~IATCADebugStream() {}
+};
+
+/* Statistics and sink dispatch shared by the IATCADebugStream
+ * implementations. Statistics and sinks have their own locks, so polling
+ * never waits behind a blocking read.
+ */
+class CDebugStreamDispatch {
+    protected:
+        struct {
+        std::mutex      _lock;
+        stream_stats_t  _stats;
+        uint64_t        _pollTime;      // CLOCK_MONOTONIC [ns] of the previous poll
+        uint64_t        _pollFrames;
+        uint64_t        _pollBytes;
+        uint64_t        _hwFrameBase;   // implementation's frame counter at the last reset
+        } _streamStats[MAX_DEBUG_STREAM];
+
+        struct {
+        std::mutex                   _lock;
+        std::vector<StreamFrameSink> _list;
+        } _streamSinks[MAX_DEBUG_STREAM];
+
+    public:
+        CDebugStreamDispatch();
+
+        /* account for one read and pass a received frame to the sinks;
+         * readyTime 0 if the implementation cannot tell */
+        void     frameDone(uint32_t index, const uint8_t *buf, int64_t got, uint64_t arrivalTime, uint64_t readyTime = 0);
+        void     getStats(stream_stats_t *stats, uint32_t index);
+        void     resetStats(uint32_t index, uint64_t hwFrameBase = 0);
+        /* frames received since the last reset and, optionally, the
+         * hwFrameBase passed to that reset, read under one lock */
+        uint64_t getHostFrames(uint32_t index, uint64_t *hwFrameBase = NULL);
+        void     addSink(StreamFrameSink sink, uint32_t index);
+        void     removeSink(StreamFrameSink sink, uint32_t index);
+};
+
+#endif /* _DEBUG_STREAM_H */
@@ -0,0 +1,237 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+
+#include <vector>
+#include <mutex>
+
+#include "eventBuilder.h"
+
+/* acquisition numbered in eventMatchTriggerCount mode */
+typedef struct {
+    uint64_t  timestamp;      // sec << 32 | nsec
+    uint64_t  count;          // 0: unused
+} event_count_t;
+
+typedef struct {
+    int                  busy;
+    daq_event_t          event;
+    std::vector<uint8_t> buffer[MAX_DEBUG_STREAM];
+} event_slot_t;
+
+class CEventBuilder : public IEventBuilder {
+    protected:
+        event_builder_config_t     _config;
+        DaqEventSink               _sink;
+        std::mutex                 _lock;
+        std::vector<event_slot_t>  _slot;
+        stream_format_t            _format[MAX_DEBUG_STREAM];
+        uint64_t                   _trigCount[MAX_DEBUG_STREAM];
+        uint64_t                   _lastCount;        // highest count handed out for a header timestamp
+        std::vector<event_count_t> _recent;           // ring of recently numbered acquisitions
+        unsigned                   _recentNext;
+        event_builder_stats_t      _stats;
+
+        uint64_t      resyncCount(uint32_t stream, uint64_t timestamp);
+        bool          matches(const event_slot_t *s, uint64_t key);
+        event_slot_t *findSlot(uint64_t key, uint32_t stream);
+        void          emit(event_slot_t *s);
+        void          expireLocked(uint64_t now);
+
+    public:
+        CEventBuilder(const event_builder_config_t *config, DaqEventSink sink);
+
+        virtual void processFrame(const stream_frame_t *frame);
+        virtual void setFormat(uint32_t stream, const stream_format_t *format);
+        virtual void setTriggerCountBase(uint32_t stream, uint32_t trigCount);
+        virtual void expire();
+        virtual void getStats(event_builder_stats_t *stats);
+};
+
+EventBuilder IEventBuilder::create(const event_builder_config_t *config, DaqEventSink sink)
+{
+    return EventBuilder(new CEventBuilder(config, sink));
+}
+
+CEventBuilder::CEventBuilder(const event_builder_config_t *config, DaqEventSink sink) :
+    _config(*config),
+    _sink(sink),
+    _slot(config->maxPending),
+    _lastCount(0),
+    _recent(config->maxPending),
+    _recentNext(0)
+{
+    for(unsigned i = 0; i < _slot.size(); i++) {
+        _slot[i].busy = 0;
+        for(int j = 0; j < MAX_DEBUG_STREAM; j++)
+            if(_config.streamMask & (1 << j)) _slot[i].buffer[j].resize(_config.maxFrameSize);
+    }
+
+    for(unsigned i = 0; i < _recent.size(); i++) _recent[i].count = 0;
+
+    memset(_format, 0, sizeof(_format));
+    memset(_trigCount, 0, sizeof(_trigCount));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void CEventBuilder::setFormat(uint32_t stream, const stream_format_t *format)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _format[stream] = *format;
+}
+
+void CEventBuilder::setTriggerCountBase(uint32_t stream, uint32_t trigCount)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _trigCount[stream] = trigCount;
+    _lastCount         = trigCount;
+    for(unsigned i = 0; i < _recent.size(); i++) _recent[i].count = 0;
+}
+
+/* header timestamps are sec << 32 | nsec */
+static uint64_t timestampDiff(uint64_t a, uint64_t b)
+{
+    uint64_t na = (a >> 32) * 1000000000ULL + (a & 0xffffffff);
+    uint64_t nb = (b >> 32) * 1000000000ULL + (b & 0xffffffff);
+
+    return na > nb ? na - nb : nb - na;
+}
+
+uint64_t CEventBuilder::resyncCount(uint32_t stream, uint64_t timestamp)
+{
+    for(unsigned i = 0; i < _recent.size(); i++) {
+        event_count_t *r = &_recent[i];
+        if(r->count && timestampDiff(r->timestamp, timestamp) <= _config.tolerance)
+            return _trigCount[stream] = r->count;
+    }
+
+    uint64_t count = (_trigCount[stream] > _lastCount ? _trigCount[stream] : _lastCount) + 1;
+
+    if(_recent.size()) {
+        _recent[_recentNext].timestamp = timestamp;
+        _recent[_recentNext].count     = count;
+        _recentNext = (_recentNext + 1) % _recent.size();
+    }
+    _lastCount = count;
+    return _trigCount[stream] = count;
+}
+
+bool CEventBuilder::matches(const event_slot_t *s, uint64_t key)
+{
+    if(_config.match == eventMatchTriggerCount)
+        return s->event.key == key;
+
+    return timestampDiff(s->event.key, key) <= _config.tolerance;
+}
+
+event_slot_t *CEventBuilder::findSlot(uint64_t key, uint32_t stream)
+{
+    event_slot_t *freeSlot = NULL;
+
+    for(unsigned i = 0; i < _slot.size(); i++) {
+        event_slot_t *s = &_slot[i];
+        if(!s->busy) {
+            if(!freeSlot) freeSlot = s;
+            continue;
+        }
+        if(matches(s, key)) {
+            if(s->event.streamMask & (1 << stream)) {
+                _stats.duplicate++;
+                return NULL;
+            }
+            return s;
+        }
+    }
+
+    if(!freeSlot) {
+        _stats.noSlot++;
+        return NULL;
+    }
+
+    memset(&freeSlot->event, 0, sizeof(daq_event_t));
+    freeSlot->busy      = 1;
+    freeSlot->event.key = key;
+    return freeSlot;
+}
+
+void CEventBuilder::emit(event_slot_t *s)
+{
+    s->event.complete = (s->event.streamMask == _config.streamMask);
+    if(s->event.complete) _stats.complete++;
+    else                  _stats.incomplete++;
+
+    if(_sink) _sink->processEvent(&s->event);
+    s->busy = 0;
+}
+
+void CEventBuilder::expireLocked(uint64_t now)
+{
+    for(unsigned i = 0; i < _slot.size(); i++) {
+        event_slot_t *s = &_slot[i];
+        if(s->busy && now > s->event.firstArrival && now - s->event.firstArrival > _config.timeout) emit(s);
+    }
+}
+
+void CEventBuilder::processFrame(const stream_frame_t *frame)
+{
+    uint32_t        stream = frame->stream;
+    uint64_t        key;
+    daqmux_header_t header;
+
+    if(stream >= MAX_DEBUG_STREAM || !(_config.streamMask & (1 << stream)))
+        return;
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    bool hasHeader = _format[stream].header && !parseStreamHeader(frame, &header);
+
+    if(_config.match == eventMatchTriggerCount) {
+        key = hasHeader ? resyncCount(stream, streamHeaderTimestamp(&header)) : ++_trigCount[stream];
+    } else {
+        if(!hasHeader) {
+            _stats.noHeader++;
+            return;
+        }
+        key = streamHeaderTimestamp(&header);
+    }
+
+    expireLocked(frame->arrivalTime);
+
+    event_slot_t *s = findSlot(key, stream);
+    if(!s)
+        return;
+
+    uint64_t size = frame->size;
+    if(size > _config.maxFrameSize) {
+        size = _config.maxFrameSize;
+        _stats.truncated++;
+    }
+    memcpy(s->buffer[stream].data(), frame->data, size);
+
+    if(!s->event.streamMask) s->event.firstArrival = frame->arrivalTime;
+    s->event.lastArrival   = frame->arrivalTime;
+    s->event.streamMask   |= (1 << stream);
+    s->event.data[stream]  = s->buffer[stream].data();
+    s->event.size[stream]  = size;
+
+    if(s->event.streamMask == _config.streamMask) emit(s);
+}
+
+void CEventBuilder::expire()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    expireLocked(streamMonotonicTime());
+}
+
+void CEventBuilder::getStats(event_builder_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    *stats = _stats;
+}
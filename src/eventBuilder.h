@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _EVENT_BUILDER_H
+#define _EVENT_BUILDER_H
+
+#include "streamFrame.h"
+
+typedef enum {
+    eventMatchTimestamp = 0,   // packet header timestamp, within a tolerance
+    eventMatchTriggerCount     // acquisition count from a common TrigCount
+} event_match_t;
+
+typedef struct {
+    uint32_t       streamMask;      // streams taking part in an event
+    event_match_t  match;
+    uint64_t       tolerance;       // max header timestamp difference within an event [ns]
+    uint64_t       timeout;         // incomplete events are emitted after this [ns]
+    unsigned       maxPending;      // events under construction
+    uint64_t       maxFrameSize;    // bytes
+} event_builder_config_t;
+
+typedef struct {
+    uint64_t        key;            // header timestamp (sec << 32 | nsec) or trigger count
+    uint32_t        streamMask;     // streams present in this event
+    int             complete;       // all configured streams present
+    uint64_t        firstArrival;   // CLOCK_MONOTONIC [ns]
+    uint64_t        lastArrival;
+    const uint8_t  *data[MAX_DEBUG_STREAM];
+    uint64_t        size[MAX_DEBUG_STREAM];
+} daq_event_t;
+
+typedef struct {
+    uint64_t        complete;       // events emitted with every stream present
+    uint64_t        incomplete;     // events emitted on timeout
+    uint64_t        noSlot;         // frames dropped, all pending slots in use
+    uint64_t        duplicate;      // frames dropped, stream already present in the event
+    uint64_t        truncated;      // frames larger than maxFrameSize
+    uint64_t        noHeader;       // frames dropped, eventMatchTimestamp on a stream without packet header
+} event_builder_stats_t;
+
+class IDaqEventSink;
+typedef shared_ptr<IDaqEventSink> DaqEventSink;
+
+/* Called with the builder lock held, from a thread feeding frames or
+ * calling expire(). The event data is only valid during the call.
+ */
+class IDaqEventSink {
+public:
+    virtual void processEvent(const daq_event_t *event) = 0;
+    virtual ~IDaqEventSink() {}
+};
+
+class IEventBuilder;
+typedef shared_ptr<IEventBuilder> EventBuilder;
+
+/* Builds one event per trigger out of the frames of several streams, e.g.
+ * both DaqMuxes with cascadedTrigger enabled. Set the format of every
+ * stream in streamMask, then attach with addStreamSink(). Memory is
+ * allocated once, maxPending events of maxFrameSize per stream.
+ *
+ * eventMatchTimestamp needs PacketHeaderEn. With eventMatchTriggerCount
+ * and packet headers, a frame whose header timestamp is within tolerance
+ * of a recent acquisition takes that acquisition's count, and a new
+ * timestamp takes the next count after the highest one so far, so a lost
+ * frame does not shift later events. Without headers every frame counts
+ * as one acquisition of its stream and a lost frame shifts that stream.
+ *
+ * Timeouts are checked whenever a frame arrives; call expire() from a
+ * periodic scan as well so events still get flushed when streams stop.
+ */
+class IEventBuilder : public IStreamFrameSink {
+public:
+    static EventBuilder create(const event_builder_config_t *config, DaqEventSink sink);
+
+    virtual void setFormat(uint32_t stream, const stream_format_t *format) = 0;
+    /* eventMatchTriggerCount: TrigCount of the DaqMux before the first frame */
+    virtual void setTriggerCountBase(uint32_t stream, uint32_t trigCount) = 0;
+    virtual void expire() = 0;
+    virtual void getStats(event_builder_stats_t *stats) = 0;
+};
+
+#endif /* _EVENT_BUILDER_H */
@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+
+#include "latencyHistogram.h"
+
+CLatencyHistogram::CLatencyHistogram()
+{
+    reset();
+}
+
+void CLatencyHistogram::reset()
+{
+    memset(_bin, 0, sizeof(_bin));
+    _count = 0;
+    _min   = 0;
+    _max   = 0;
+    _sum   = 0.;
+}
+
+/* values below 16 ns map 1:1, above that bin = octave * 16 + 4 mantissa bits */
+unsigned CLatencyHistogram::binIndex(uint64_t ns)
+{
+    if(ns < LATENCY_SUB_BINS)
+        return ns;
+
+    unsigned msb = 63 - __builtin_clzll(ns);
+    unsigned sub = (ns >> (msb - LATENCY_SUB_BINS_LOG2)) & (LATENCY_SUB_BINS - 1);
+
+    return (msb - LATENCY_SUB_BINS_LOG2 + 1) * LATENCY_SUB_BINS + sub;
+}
+
+/* lower edge of a bin */
+uint64_t CLatencyHistogram::binValue(unsigned bin)
+{
+    if(bin < LATENCY_SUB_BINS)
+        return bin;
+
+    unsigned msb = bin / LATENCY_SUB_BINS + LATENCY_SUB_BINS_LOG2 - 1;
+    uint64_t sub = bin % LATENCY_SUB_BINS;
+
+    return (1ULL << msb) | (sub << (msb - LATENCY_SUB_BINS_LOG2));
+}
+
+void CLatencyHistogram::add(uint64_t ns)
+{
+    _bin[binIndex(ns)]++;
+    if(!_count || ns < _min) _min = ns;
+    if(ns > _max)            _max = ns;
+    _sum += ns;
+    _count++;
+}
+
+uint64_t CLatencyHistogram::percentile(double p) const
+{
+    uint64_t rank = (uint64_t) (p * 0.01 * _count);
+    uint64_t seen = 0;
+
+    if(!_count)
+        return 0;
+    if(rank >= _count) rank = _count - 1;
+
+    for(unsigned i = 0; i < LATENCY_BINS - 1; i++) {
+        seen += _bin[i];
+        if(seen > rank) {
+            uint64_t v = binValue(i) + (binValue(i + 1) - binValue(i)) / 2;   /* bin centre */
+            return v < _min ? _min : v > _max ? _max : v;
+        }
+    }
+    return _max;
+}
+
+void CLatencyHistogram::getReport(latency_report_t *report) const
+{
+    report->count = _count;
+    report->min   = _min;
+    report->max   = _max;
+    report->mean  = _count ? _sum / _count : 0.;
+    report->p50   = percentile(50.);
+    report->p99   = percentile(99.);
+    report->p999  = percentile(99.9);
+}
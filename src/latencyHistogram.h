@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define LATENCY_SUB_BINS_LOG2  4
+#define LATENCY_SUB_BINS       (1 << LATENCY_SUB_BINS_LOG2)
+#define LATENCY_BINS           (64 * LATENCY_SUB_BINS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t min;       // [ns]
+    uint64_t max;
+    double   mean;
+    uint64_t p50;       // percentiles, within the 1/16 octave bin resolution
+    uint64_t p99;
+    uint64_t p999;
+} latency_report_t;
+
+/* Log-linear histogram of latencies in ns: every power of two is split
+ * into 16 bins, i.e. about 6% resolution over the full 64 bit range.
+ * Not thread safe; callers lock.
+ */
+class CLatencyHistogram {
+    protected:
+        uint64_t _bin[LATENCY_BINS];
+        uint64_t _count;
+        uint64_t _min;
+        uint64_t _max;
+        double   _sum;
+
+        static unsigned binIndex(uint64_t ns);
+        static uint64_t binValue(unsigned bin);
+
+    public:
+        CLatencyHistogram();
+
+        void     reset();
+        void     add(uint64_t ns);
+        uint64_t percentile(double p) const;
+        void     getReport(latency_report_t *report) const;
+};
+
+#endif /* _LATENCY_HISTOGRAM_H */
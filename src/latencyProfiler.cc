@@ -0,0 +1,206 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include "latencyProfiler.h"
+
+#define MAX_PENDING_TRIGGERS    64
+
+typedef struct {
+    uint64_t          time;             // CLOCK_MONOTONIC [ns]
+    uint64_t          prevTimestamp;    // DaqMux Timestamp before the trigger, sec << 32 | nsec
+    latency_source_t  source;
+} latency_trigger_t;
+
+typedef struct {
+    std::deque<latency_trigger_t> pending;
+    CLatencyHistogram             hist[latencySourceCnt];
+    CLatencyHistogram             bench;
+    bool                          benchActive;
+    bool                          header;          // PacketHeaderEn when the last trigger was issued
+    uint64_t                      lastTimestamp;   // header timestamp of the last acquisition
+    uint64_t                      matched;         // acquisitions matched so far
+    uint64_t                      timeouts;
+} latency_daqmux_t;
+
+class CLatencyProfiler : public ILatencyProfiler {
+    protected:
+        ATCACommonFw              _fw;
+        std::mutex                _lock;
+        std::condition_variable   _cond;
+        latency_daqmux_t          _daqMux[MAX_DAQMUX_CNT];
+
+        void markTrigger(int index, latency_source_t source);
+
+    public:
+        CLatencyProfiler(ATCACommonFw fw);
+
+        virtual void processFrame(const stream_frame_t *frame);
+        virtual void triggerDaq(int index);
+        virtual void armHwTrigger(int index);
+        virtual void getReport(latency_report_t *report, int index, latency_source_t source);
+        virtual void reset(int index);
+        virtual uint64_t getTimeouts(int index);
+        virtual int  runBenchmark(int index, unsigned count, unsigned timeout, latency_report_t *report);
+};
+
+LatencyProfiler ILatencyProfiler::create(ATCACommonFw fw)
+{
+    return LatencyProfiler(new CLatencyProfiler(fw));
+}
+
+CLatencyProfiler::CLatencyProfiler(ATCACommonFw fw) :
+    _fw(fw)
+{
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++) {
+        _daqMux[i].benchActive   = false;
+        _daqMux[i].header        = false;
+        _daqMux[i].lastTimestamp = 0;
+        _daqMux[i].matched       = 0;
+        _daqMux[i].timeouts      = 0;
+    }
+}
+
+void CLatencyProfiler::markTrigger(int index, latency_source_t source)
+{
+    latency_trigger_t t;
+    stream_format_t   format;
+    uint32_t          sec, nsec;
+
+    _fw->getStreamFormat(&format, index * STREAMS_PER_DAQMUX);
+    _fw->getTimestamp(&sec, &nsec, index);
+
+    t.prevTimestamp = ((uint64_t) sec << 32) | nsec;
+    t.time          = streamMonotonicTime();
+    t.source        = source;
+
+    std::lock_guard<std::mutex> lock(_lock);
+    _daqMux[index].header = format.header;
+    if(_daqMux[index].pending.size() >= MAX_PENDING_TRIGGERS) {
+        _daqMux[index].pending.pop_front();
+        _daqMux[index].timeouts++;
+    }
+    _daqMux[index].pending.push_back(t);
+}
+
+void CLatencyProfiler::triggerDaq(int index)
+{
+    markTrigger(index, latencySoftTrigger);
+    _fw->triggerDaq(index);
+}
+
+void CLatencyProfiler::armHwTrigger(int index)
+{
+    markTrigger(index, latencyArmTrigger);
+    _fw->armHwTrigger(index);
+}
+
+void CLatencyProfiler::processFrame(const stream_frame_t *frame)
+{
+    int              index = frame->stream / STREAMS_PER_DAQMUX;
+    daqmux_header_t  header;
+
+    if(index >= MAX_DAQMUX_CNT)
+        return;
+
+    std::lock_guard<std::mutex> lock(_lock);
+    latency_daqmux_t *d = &_daqMux[index];
+
+    if(d->pending.empty())
+        return;
+
+    if(d->header) {
+        if(parseStreamHeader(frame, &header))
+            return;
+        uint64_t ts = streamHeaderTimestamp(&header);
+        if(ts == d->lastTimestamp)      /* another channel of the same acquisition */
+            return;
+        /* an acquisition between two triggers, older than this frame,
+         * belonged to the first one, whose frames never showed up */
+        while(d->pending.size() > 1 &&
+              d->pending[0].prevTimestamp < d->pending[1].prevTimestamp &&
+              d->pending[1].prevTimestamp < ts) {
+            d->pending.pop_front();
+            d->timeouts++;
+        }
+        if(ts <= d->pending.front().prevTimestamp)     /* acquired before the trigger */
+            return;
+        d->lastTimestamp = ts;
+    }
+
+    latency_trigger_t t = d->pending.front();
+    d->pending.pop_front();
+    if(frame->arrivalTime < t.time)
+        return;
+
+    d->hist[t.source].add(frame->arrivalTime - t.time);
+    if(d->benchActive) d->bench.add(frame->arrivalTime - t.time);
+    d->matched++;
+    _cond.notify_all();
+}
+
+void CLatencyProfiler::getReport(latency_report_t *report, int index, latency_source_t source)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _daqMux[index].hist[source].getReport(report);
+}
+
+void CLatencyProfiler::reset(int index)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    for(int i = 0; i < latencySourceCnt; i++) _daqMux[index].hist[i].reset();
+    _daqMux[index].pending.clear();
+    _daqMux[index].timeouts = 0;
+}
+
+uint64_t CLatencyProfiler::getTimeouts(int index)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _daqMux[index].timeouts;
+}
+
+int CLatencyProfiler::runBenchmark(int index, unsigned count, unsigned timeout, latency_report_t *report)
+{
+    latency_daqmux_t *d = &_daqMux[index];
+    unsigned          missed = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        d->bench.reset();
+        d->pending.clear();
+        d->benchActive = true;
+    }
+
+    for(unsigned i = 0; i < count; i++) {
+        uint64_t matched;
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            matched = d->matched;
+        }
+
+        triggerDaq(index);
+
+        std::unique_lock<std::mutex> lock(_lock);
+        if(!_cond.wait_for(lock, std::chrono::milliseconds(timeout), [d, matched] { return d->matched != matched; })) {
+            d->pending.clear();
+            d->timeouts++;
+            missed++;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    d->benchActive = false;
+    d->bench.getReport(report);
+
+    return missed ? -1 : 0;
+}
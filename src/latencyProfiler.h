@@ -0,0 +1,55 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _LATENCY_PROFILER_H
+#define _LATENCY_PROFILER_H
+
+#include "atcaCommon.h"
+#include "latencyHistogram.h"
+
+typedef enum {
+    latencySoftTrigger = 0,    // triggerDaq() to first frame
+    latencyArmTrigger,         // armHwTrigger() to first frame
+    latencySourceCnt
+} latency_source_t;
+
+class ILatencyProfiler;
+typedef shared_ptr<ILatencyProfiler> LatencyProfiler;
+
+/* Trigger to data latency of the DaqMuxes.
+ *
+ * Issue triggers through the profiler, which timestamps them and forwards
+ * to the firmware, and attach the profiler to the DaqMux streams with
+ * addStreamSink(). The first frame of the resulting acquisition closes the
+ * measurement. Each trigger records the DaqMux Timestamp register, i.e.
+ * the timestamp of the previous acquisition, just before it is issued.
+ * With PacketHeaderEn set, the trigger is matched to the first frame whose
+ * header timestamp is newer than that; a trigger followed by a newer
+ * acquisition it was not matched to counts as a timeout. Without headers,
+ * the first frame after the trigger on any stream of the DaqMux is used.
+ *
+ * runBenchmark() needs another thread reading the streams meanwhile.
+ */
+class ILatencyProfiler : public IStreamFrameSink {
+public:
+    static LatencyProfiler create(ATCACommonFw fw);
+
+    virtual void triggerDaq(int index)   = 0;
+    virtual void armHwTrigger(int index) = 0;
+
+    virtual void getReport(latency_report_t *report, int index, latency_source_t source) = 0;
+    virtual void reset(int index) = 0;
+    virtual uint64_t getTimeouts(int index) = 0;
+
+    /* issue count software triggers back to back, waiting up to timeout ms
+     * for each acquisition; report covers this run only */
+    virtual int  runBenchmark(int index, unsigned count, unsigned timeout, latency_report_t *report) = 0;
+};
+
+#endif /* _LATENCY_PROFILER_H */
@@ -0,0 +1,173 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#include <vector>
+#include <mutex>
+
+#include "registerBatch.h"
+
+/* Completion state shared with the AsyncIO callbacks, which may outlive
+ * the batch object itself */
+class CBatchState {
+    public:
+        std::mutex                     lock;
+        unsigned                       pending;
+        unsigned                       errors;
+        std::vector<std::promise<int> > waiters;
+
+        CBatchState() : pending(0), errors(0) {}
+
+        void done(CPSWError *status)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            if(status) {
+                fprintf(stderr, "CPSW Error: %s (asynchronous read)\n", status->getInfo().c_str());
+                errors++;
+            }
+            if(--pending || waiters.empty())
+                return;
+            for(unsigned i = 0; i < waiters.size(); i++) waiters[i].set_value(errors ? -1 : 0);
+            waiters.clear();
+            errors = 0;
+        }
+};
+
+class CBatchRequest : public IAsyncIO {
+    protected:
+        shared_ptr<CBatchState> _state;
+
+    public:
+        CBatchRequest(shared_ptr<CBatchState> state) : _state(state) {}
+
+        virtual void callback(CPSWError *status)
+        {
+            _state->done(status);
+        }
+};
+
+typedef struct {
+    ScalVal   reg;
+    uint64_t  val;
+} batch_write_t;
+
+class CRegisterBatch : public IRegisterBatch {
+    protected:
+        shared_ptr<CBatchState>      _state;
+        std::vector<batch_write_t>   _writes;
+
+        template <typename T> void issue(ScalVal_RO reg, T *val, unsigned nelms);
+        int  flushWrites();
+        std::future<int> completion(int wrError);
+
+    public:
+        CRegisterBatch();
+        virtual ~CRegisterBatch();
+
+        virtual void get(ScalVal_RO reg, uint32_t *val, unsigned nelms);
+        virtual void get(ScalVal_RO reg, uint64_t *val, unsigned nelms);
+        virtual void set(ScalVal reg, uint64_t val);
+        virtual std::future<int> submit();
+        virtual int  wait();
+};
+
+RegisterBatch IRegisterBatch::create()
+{
+    return RegisterBatch(new CRegisterBatch());
+}
+
+CRegisterBatch::CRegisterBatch() :
+    _state(new CBatchState())
+{
+}
+
+CRegisterBatch::~CRegisterBatch()
+{
+    /* unsubmitted writes are dropped; the destination buffers of the reads
+     * belong to the caller, don't leave reads behind */
+    _writes.clear();
+    completion(0).get();
+}
+
+template <typename T> void CRegisterBatch::issue(ScalVal_RO reg, T *val, unsigned nelms)
+{
+    {
+        std::lock_guard<std::mutex> lock(_state->lock);
+        _state->pending++;
+    }
+    try {
+        reg->getVal(AsyncIO(new CBatchRequest(_state)), val, nelms);
+    } catch (CPSWError &e) {
+        /* the request never went out, complete it here */
+        _state->done(&e);
+    }
+}
+
+void CRegisterBatch::get(ScalVal_RO reg, uint32_t *val, unsigned nelms)
+{
+    issue(reg, val, nelms);
+}
+
+void CRegisterBatch::get(ScalVal_RO reg, uint64_t *val, unsigned nelms)
+{
+    issue(reg, val, nelms);
+}
+
+void CRegisterBatch::set(ScalVal reg, uint64_t val)
+{
+    batch_write_t w;
+
+    w.reg = reg;
+    w.val = val;
+    _writes.push_back(w);
+}
+
+int CRegisterBatch::flushWrites()
+{
+    int rval = 0;
+
+    for(unsigned i = 0; i < _writes.size(); i++) {
+        try {
+            _writes[i].reg->setVal(_writes[i].val);
+        } catch (CPSWError &e) {
+            fprintf(stderr, "CPSW Error: %s (batched write)\n", e.getInfo().c_str());
+            rval = -1;
+        }
+    }
+    _writes.clear();
+    return rval;
+}
+
+std::future<int> CRegisterBatch::submit()
+{
+    return completion(flushWrites());
+}
+
+/* resolved when every read issued so far completed */
+std::future<int> CRegisterBatch::completion(int wrError)
+{
+    std::promise<int> p;
+
+    std::lock_guard<std::mutex> lock(_state->lock);
+    if(!_state->pending) {
+        p.set_value(wrError || _state->errors ? -1 : 0);
+        _state->errors = 0;
+        return p.get_future();
+    }
+    if(wrError) _state->errors++;
+    _state->waiters.push_back(std::move(p));
+    return _state->waiters.back().get_future();
+}
+
+int CRegisterBatch::wait()
+{
+    return submit().get();
+}
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _REGISTER_BATCH_H
+#define _REGISTER_BATCH_H
+
+#include <cpsw_api_user.h>
+
+#include <future>
+
+class IRegisterBatch;
+typedef shared_ptr<IRegisterBatch> RegisterBatch;
+
+/* Many register reads in flight at once.
+ *
+ * get() sends the read through CPSW AsyncIO and returns immediately; the
+ * value is stored when the reply arrives, so val must stay valid until
+ * the batch completes. Issue all reads of a scan, then collect them with
+ * one wait() or through the future of submit(): the scan costs one round
+ * trip instead of one per register.
+ *
+ * CPSW has no asynchronous write. set() queues the write and submit()
+ * performs the queued writes, in order, after the reads issued so far
+ * were sent.
+ *
+ * submit()/wait() return 0 once every request issued so far completed,
+ * -1 if any of them failed (reported to stderr). The batch can be reused
+ * afterwards.
+ *
+ * Destroying a batch drops the writes not submitted yet and blocks until
+ * the reads in flight completed, as they store into the caller's buffers.
+ */
+class IRegisterBatch {
+public:
+    static RegisterBatch create();
+
+    virtual void get(ScalVal_RO reg, uint32_t *val, unsigned nelms = 1) = 0;
+    virtual void get(ScalVal_RO reg, uint64_t *val, unsigned nelms = 1) = 0;
+    virtual void set(ScalVal reg, uint64_t val) = 0;
+
+    virtual std::future<int> submit() = 0;
+    virtual int  wait() = 0;
+    virtual ~IRegisterBatch() {}
+};
+
+#endif /* _REGISTER_BATCH_H */
@@ -0,0 +1,368 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+
+#include "shmFrameRing.h"
+
+#define SHM_RING_MAGIC    0x41545348   /* "ATSH" */
+#define SHM_RING_VERSION  1
+#define SHM_CACHE_LINE    64
+
+#if ATOMIC_LLONG_LOCK_FREE != 2 || ATOMIC_INT_LOCK_FREE != 2
+#error "the shared memory ring needs address free 32 and 64 bit atomics"
+#endif
+
+/* Shared memory layout: shm_ring_header_t, then slotCount slots of
+ * slotStride bytes, each a shm_slot_t followed by the frame data.
+ *
+ * Slot n % slotCount holds frame n. Its seq is 2n + 1 while the frame is
+ * being written and 2n + 2 once it is complete. A writer only takes a
+ * slot whose seq is even and below 2n, so it never overwrites a newer
+ * frame or one still being written.
+ */
+typedef struct {
+    std::atomic<int32_t>   pid;         // 0: entry free
+    std::atomic<uint64_t>  cursor;      // next frame to consume
+    std::atomic<uint64_t>  frames;
+    std::atomic<uint64_t>  overruns;
+} shm_consumer_t;
+
+typedef struct {
+    uint32_t               magic;
+    uint32_t               version;
+    uint32_t               slotCount;
+    uint32_t               reserved;
+    uint64_t               slotSize;
+    uint64_t               slotStride;
+    stream_format_t        format[MAX_DEBUG_STREAM];
+    std::atomic<uint64_t>  head __attribute__ ((aligned (SHM_CACHE_LINE)));  // frames claimed by the publisher
+    shm_consumer_t         consumer[SHM_MAX_CONSUMERS] __attribute__ ((aligned (SHM_CACHE_LINE)));
+} shm_ring_header_t;
+
+typedef struct {
+    std::atomic<uint64_t>  seq;
+    uint32_t               stream;
+    uint32_t               reserved;
+    uint64_t               size;
+    uint64_t               arrivalTime;
+} shm_slot_t;
+
+#define SHM_HEADER_SIZE  ((sizeof(shm_ring_header_t) + SHM_CACHE_LINE - 1) & ~(uint64_t) (SHM_CACHE_LINE - 1))
+
+static inline shm_slot_t *ringSlot(shm_ring_header_t *ring, uint64_t n)
+{
+    return (shm_slot_t *) ((uint8_t *) ring + SHM_HEADER_SIZE + (n % ring->slotCount) * ring->slotStride);
+}
+
+
+class CShmFramePublisher : public IShmFramePublisher {
+    protected:
+        char                   _name[256];
+        shm_ring_header_t     *_ring;
+        uint64_t               _mapSize;
+        std::atomic<uint64_t>  _dropped;
+        std::atomic<uint64_t>  _lapped;
+
+    public:
+        CShmFramePublisher(const char *name, shm_ring_header_t *ring, uint64_t mapSize);
+        virtual ~CShmFramePublisher();
+
+        virtual void processFrame(const stream_frame_t *frame);
+        virtual void getStats(shm_publisher_stats_t *stats);
+        virtual void getConsumers(std::vector<shm_consumer_stats_t> *consumers);
+};
+
+ShmFramePublisher IShmFramePublisher::create(const char *name, uint32_t slotCount, uint64_t slotSize,
+                                             const stream_format_t format[MAX_DEBUG_STREAM], bool force)
+{
+    uint64_t           stride  = (sizeof(shm_slot_t) + slotSize + SHM_CACHE_LINE - 1) & ~(uint64_t) (SHM_CACHE_LINE - 1);
+    uint64_t           mapSize = SHM_HEADER_SIZE + slotCount * stride;
+    shm_ring_header_t *ring;
+    void              *p;
+    int                fd;
+
+    if(!slotCount || strlen(name) >= 256) {
+        fprintf(stderr, "IShmFramePublisher: invalid ring %s\n", name);
+        return ShmFramePublisher();
+    }
+
+    /* consumers of a previous ring keep their mapping of the old object */
+    if(force) shm_unlink(name);
+    if((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666)) < 0) {
+        fprintf(stderr, "IShmFramePublisher: cannot create %s (%s)\n", name, strerror(errno));
+        return ShmFramePublisher();
+    }
+    if(ftruncate(fd, mapSize) || (p = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "IShmFramePublisher: cannot map %s (%s)\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return ShmFramePublisher();
+    }
+    close(fd);
+
+    /* a new object is zero filled, i.e. every counter and seq is 0 */
+    ring             = (shm_ring_header_t *) p;
+    ring->slotCount  = slotCount;
+    ring->slotSize   = slotSize;
+    ring->slotStride = stride;
+    memcpy(ring->format, format, sizeof(ring->format));
+    ring->version    = SHM_RING_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    ring->magic      = SHM_RING_MAGIC;
+
+    return ShmFramePublisher(new CShmFramePublisher(name, ring, mapSize));
+}
+
+CShmFramePublisher::CShmFramePublisher(const char *name, shm_ring_header_t *ring, uint64_t mapSize) :
+    _ring(ring),
+    _mapSize(mapSize),
+    _dropped(0),
+    _lapped(0)
+{
+    strcpy(_name, name);
+}
+
+CShmFramePublisher::~CShmFramePublisher()
+{
+    munmap(_ring, _mapSize);
+    shm_unlink(_name);
+}
+
+void CShmFramePublisher::processFrame(const stream_frame_t *frame)
+{
+    if(frame->size > _ring->slotSize) {
+        _dropped++;
+        return;
+    }
+
+    uint64_t    n    = _ring->head.fetch_add(1, std::memory_order_relaxed);
+    shm_slot_t *s    = ringSlot(_ring, n);
+    uint64_t    prev = s->seq.load(std::memory_order_relaxed);
+
+    while(1) {
+        if(prev > 2 * n) {          /* a later frame took the slot, consumers count an overrun */
+            _lapped++;
+            return;
+        }
+        if(prev & 1) {              /* the previous frame of this slot is still being written */
+            sched_yield();
+            prev = s->seq.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(s->seq.compare_exchange_weak(prev, 2 * n + 1, std::memory_order_relaxed))
+            break;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s->stream      = frame->stream;
+    s->size        = frame->size;
+    s->arrivalTime = frame->arrivalTime;
+    memcpy((uint8_t *) (s + 1), frame->data, frame->size);
+
+    s->seq.store(2 * n + 2, std::memory_order_release);
+}
+
+void CShmFramePublisher::getStats(shm_publisher_stats_t *stats)
+{
+    stats->published = _ring->head.load(std::memory_order_relaxed);
+    stats->dropped   = _dropped;
+    stats->lapped    = _lapped;
+}
+
+void CShmFramePublisher::getConsumers(std::vector<shm_consumer_stats_t> *consumers)
+{
+    uint64_t head = _ring->head.load(std::memory_order_relaxed);
+
+    consumers->clear();
+    for(int i = 0; i < SHM_MAX_CONSUMERS; i++) {
+        shm_consumer_t       *c = &_ring->consumer[i];
+        shm_consumer_stats_t  stats;
+
+        if(!(stats.pid = c->pid.load(std::memory_order_relaxed)))
+            continue;
+        uint64_t cursor = c->cursor.load(std::memory_order_relaxed);
+        stats.frames    = c->frames.load(std::memory_order_relaxed);
+        stats.overruns  = c->overruns.load(std::memory_order_relaxed);
+        stats.lag       = head > cursor ? head - cursor : 0;
+        consumers->push_back(stats);
+    }
+}
+
+
+class CShmFrameConsumer : public IShmFrameConsumer {
+    protected:
+        shm_ring_header_t  *_ring;
+        uint64_t            _mapSize;
+        shm_consumer_t     *_self;
+        uint64_t            _cursor;
+        uint64_t            _expected;      // seq of the frame handed out by next(), 0: none
+        uint64_t            _frames;
+        uint64_t            _overruns;
+
+        void publishCursor();
+
+    public:
+        CShmFrameConsumer(shm_ring_header_t *ring, uint64_t mapSize, shm_consumer_t *self);
+        virtual ~CShmFrameConsumer();
+
+        virtual int  next(stream_frame_t *frame);
+        virtual int  done();
+        virtual void getFormat(stream_format_t *format, uint32_t stream);
+        virtual void getStats(shm_consumer_stats_t *stats);
+};
+
+ShmFrameConsumer IShmFrameConsumer::create(const char *name)
+{
+    shm_ring_header_t *ring;
+    struct stat        st;
+    void              *p;
+    int                fd;
+
+    if((fd = shm_open(name, O_RDWR, 0)) < 0) {
+        fprintf(stderr, "IShmFrameConsumer: cannot open %s (%s)\n", name, strerror(errno));
+        return ShmFrameConsumer();
+    }
+    if(fstat(fd, &st) || (uint64_t) st.st_size < SHM_HEADER_SIZE ||
+       (p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "IShmFrameConsumer: cannot map %s\n", name);
+        close(fd);
+        return ShmFrameConsumer();
+    }
+    close(fd);
+
+    ring = (shm_ring_header_t *) p;
+    if(ring->magic != SHM_RING_MAGIC || ring->version != SHM_RING_VERSION ||
+       SHM_HEADER_SIZE + ring->slotCount * ring->slotStride > (uint64_t) st.st_size) {
+        fprintf(stderr, "IShmFrameConsumer: %s is not a frame ring\n", name);
+        munmap(p, st.st_size);
+        return ShmFrameConsumer();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    /* take a free entry, or one left behind by a process which died */
+    for(int i = 0; i < SHM_MAX_CONSUMERS; i++) {
+        shm_consumer_t *c   = &ring->consumer[i];
+        int32_t         pid = c->pid.load();
+
+        if(pid && (kill(pid, 0) == 0 || errno != ESRCH))
+            continue;
+        if(c->pid.compare_exchange_strong(pid, getpid()))
+            return ShmFrameConsumer(new CShmFrameConsumer(ring, st.st_size, c));
+    }
+
+    fprintf(stderr, "IShmFrameConsumer: no free consumer entry in %s\n", name);
+    munmap(p, st.st_size);
+    return ShmFrameConsumer();
+}
+
+CShmFrameConsumer::CShmFrameConsumer(shm_ring_header_t *ring, uint64_t mapSize, shm_consumer_t *self) :
+    _ring(ring),
+    _mapSize(mapSize),
+    _self(self),
+    _cursor(ring->head.load(std::memory_order_acquire)),
+    _expected(0),
+    _frames(0),
+    _overruns(0)
+{
+    publishCursor();
+}
+
+CShmFrameConsumer::~CShmFrameConsumer()
+{
+    _self->pid.store(0);
+    munmap(_ring, _mapSize);
+}
+
+void CShmFrameConsumer::publishCursor()
+{
+    _self->cursor.store(_cursor,     std::memory_order_relaxed);
+    _self->frames.store(_frames,     std::memory_order_relaxed);
+    _self->overruns.store(_overruns, std::memory_order_relaxed);
+}
+
+int CShmFrameConsumer::next(stream_frame_t *frame)
+{
+    if(_expected)       /* previous frame not done() yet */
+        done();
+
+    while(1) {
+        uint64_t head = _ring->head.load(std::memory_order_acquire);
+
+        if(_cursor >= head)
+            return 0;
+        if(head - _cursor > _ring->slotCount) {     /* lapped by the publisher */
+            _overruns += head - _cursor - _ring->slotCount;
+            _cursor    = head - _ring->slotCount;
+            publishCursor();
+        }
+
+        shm_slot_t *s   = ringSlot(_ring, _cursor);
+        uint64_t    seq = s->seq.load(std::memory_order_acquire);
+
+        if(seq < 2 * _cursor + 2)                   /* claimed, still being written */
+            return 0;
+        if(seq > 2 * _cursor + 2) {                 /* already reused for a later frame */
+            _overruns++;
+            _cursor++;
+            publishCursor();
+            continue;
+        }
+
+        frame->stream      = s->stream;
+        frame->size        = s->size < _ring->slotSize ? s->size : _ring->slotSize;
+        frame->arrivalTime = s->arrivalTime;
+        frame->readyTime   = 0;
+        frame->data        = (const uint8_t *) (s + 1);
+        _expected          = seq;
+        return 1;
+    }
+}
+
+int CShmFrameConsumer::done()
+{
+    if(!_expected)
+        return -1;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool intact = ringSlot(_ring, _cursor)->seq.load(std::memory_order_relaxed) == _expected;
+
+    if(intact) _frames++;
+    else       _overruns++;
+    _cursor++;
+    _expected = 0;
+    publishCursor();
+
+    return intact ? 0 : -1;
+}
+
+void CShmFrameConsumer::getFormat(stream_format_t *format, uint32_t stream)
+{
+    *format = _ring->format[stream];
+}
+
+void CShmFrameConsumer::getStats(shm_consumer_stats_t *stats)
+{
+    uint64_t head = _ring->head.load(std::memory_order_relaxed);
+
+    stats->pid      = getpid();
+    stats->frames   = _frames;
+    stats->overruns = _overruns;
+    stats->lag      = head > _cursor ? head - _cursor : 0;
+}
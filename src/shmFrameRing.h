@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _SHM_FRAME_RING_H
+#define _SHM_FRAME_RING_H
+
+#include <vector>
+
+#include "streamFrame.h"
+
+#define SHM_MAX_CONSUMERS  16
+
+typedef struct {
+    uint64_t  published;      // frames written to the ring
+    uint64_t  dropped;        // frames larger than a slot
+    uint64_t  lapped;         // frames whose slot a later frame took before they were written
+} shm_publisher_stats_t;
+
+typedef struct {
+    int32_t   pid;
+    uint64_t  frames;         // frames consumed intact
+    uint64_t  overruns;       // frames overwritten before or while being consumed
+    uint64_t  lag;            // frames published but not consumed yet
+} shm_consumer_stats_t;
+
+class IShmFramePublisher;
+typedef shared_ptr<IShmFramePublisher> ShmFramePublisher;
+
+/* Fan-out of stream frames to other processes through a POSIX shared
+ * memory ring of slotCount slots of up to slotSize bytes.
+ *
+ * Attach the publisher to the streams with addStreamSink(). Every frame
+ * is copied once into the next slot; the publisher never waits for
+ * consumers, a slow consumer is overrun instead. Each slot carries a
+ * sequence lock, so consumers read frames in place and check afterwards
+ * whether they were overwritten meanwhile. Several reader threads of the
+ * process may publish concurrently: a writer claims its slot with a
+ * compare-and-swap on the slot's sequence, waits while the previous frame
+ * in that slot is still being written and gives up the frame if a later
+ * frame already took the slot. slotCount should well exceed the number
+ * of publishing threads.
+ *
+ * The publisher creates the shared memory object name (e.g. "/atca0")
+ * and unlinks it when destroyed. Creation fails if the object exists,
+ * which keeps a second publisher from taking over a running ring; force
+ * removes it first, for a ring left behind by a publisher which died.
+ * Consumers of the old ring keep their mapping of it. Returns a null
+ * pointer on failure.
+ */
+class IShmFramePublisher : public IStreamFrameSink {
+public:
+    static ShmFramePublisher create(const char *name, uint32_t slotCount, uint64_t slotSize,
+                                    const stream_format_t format[MAX_DEBUG_STREAM], bool force = false);
+
+    virtual void getStats(shm_publisher_stats_t *stats) = 0;
+    /* consumers currently attached to the ring */
+    virtual void getConsumers(std::vector<shm_consumer_stats_t> *consumers) = 0;
+};
+
+class IShmFrameConsumer;
+typedef shared_ptr<IShmFrameConsumer> ShmFrameConsumer;
+
+/* Reader side of an IShmFramePublisher ring, in any local process.
+ *
+ * A consumer starts at the newest frame and keeps its own cursor, which
+ * it publishes in the ring header for monitoring only. next() never
+ * blocks: it returns 1 with frame->data pointing into the shared memory,
+ * or 0 if no new frame is available. Call done() when finished with the
+ * frame; it returns 0 if the frame stayed intact, -1 if the publisher
+ * overwrote it meanwhile and the data must be discarded.
+ *
+ * Returns a null pointer if the ring does not exist or all
+ * SHM_MAX_CONSUMERS consumer entries are in use.
+ */
+class IShmFrameConsumer {
+public:
+    static ShmFrameConsumer create(const char *name);
+
+    virtual int  next(stream_frame_t *frame) = 0;
+    virtual int  done() = 0;
+    virtual void getFormat(stream_format_t *format, uint32_t stream) = 0;
+    virtual void getStats(shm_consumer_stats_t *stats) = 0;
+    virtual ~IShmFrameConsumer() {}
+};
+
+#endif /* _SHM_FRAME_RING_H */
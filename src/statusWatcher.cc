@@ -0,0 +1,210 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "statusWatcher.h"
+
+static const char *registerName[statusRegisterCnt] = {
+    "DbgInputValid",
+    "DbgLinkReady",
+    "StreamPause",
+    "StreamReady",
+    "StreamOverflow",
+    "StreamError",
+    "InputDataValid",
+    "StreamEnabled"
+};
+
+const char *statusRegisterName(status_register_t reg)
+{
+    return reg < statusRegisterCnt ? registerName[reg] : "unknown";
+}
+
+class CStatusWatcher : public IStatusWatcher {
+    protected:
+        ATCACommonFw                   _fw;
+        uint32_t                       _daqMuxMask;
+        unsigned                       _period;
+        std::mutex                     _lock;
+        std::condition_variable        _cond;
+        std::thread                    _thread;
+        bool                           _run;
+        std::vector<StatusEventSink>   _sinks;
+        daqmux_status_t                _status[MAX_DAQMUX_CNT];
+        bool                           _valid[MAX_DAQMUX_CNT];
+
+        void watchLoop();
+        void scan(RegisterBatch batch);
+        void compare(int index, const daqmux_status_t *now, uint64_t time, std::vector<status_event_t> *events);
+
+    public:
+        CStatusWatcher(ATCACommonFw fw, uint32_t daqMuxMask, unsigned period);
+        virtual ~CStatusWatcher();
+
+        virtual void subscribe(StatusEventSink sink);
+        virtual void unsubscribe(StatusEventSink sink);
+        virtual void start();
+        virtual void stop();
+        virtual int  getStatus(daqmux_status_t *status, int index);
+};
+
+StatusWatcher IStatusWatcher::create(ATCACommonFw fw, uint32_t daqMuxMask, unsigned period)
+{
+    return StatusWatcher(new CStatusWatcher(fw, daqMuxMask, period));
+}
+
+CStatusWatcher::CStatusWatcher(ATCACommonFw fw, uint32_t daqMuxMask, unsigned period) :
+    _fw(fw),
+    _daqMuxMask(daqMuxMask),
+    _period(period),
+    _run(false)
+{
+    for(int i = 0; i < MAX_DAQMUX_CNT; i++) _valid[i] = false;
+}
+
+CStatusWatcher::~CStatusWatcher()
+{
+    stop();
+}
+
+void CStatusWatcher::subscribe(StatusEventSink sink)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _sinks.push_back(sink);
+}
+
+void CStatusWatcher::unsubscribe(StatusEventSink sink)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _sinks.erase(std::remove(_sinks.begin(), _sinks.end(), sink), _sinks.end());
+}
+
+void CStatusWatcher::start()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(_run)
+        return;
+
+    _run    = true;
+    _thread = std::thread(&CStatusWatcher::watchLoop, this);
+}
+
+void CStatusWatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        if(!_run)
+            return;
+        _run = false;
+        _cond.notify_one();
+    }
+    _thread.join();
+}
+
+int CStatusWatcher::getStatus(daqmux_status_t *status, int index)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if(!_valid[index])
+        return -1;
+    *status = _status[index];
+    return 0;
+}
+
+void CStatusWatcher::watchLoop()
+{
+    RegisterBatch                batch = IRegisterBatch::create();
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while(_run) {
+        lock.unlock();
+        scan(batch);
+        lock.lock();
+
+        _cond.wait_for(lock, std::chrono::milliseconds(_period));
+    }
+}
+
+static void compareReg(std::vector<status_event_t> *events, status_event_t *e, status_register_t reg, int channel,
+                       uint32_t oldVal, uint32_t newVal)
+{
+    if(oldVal == newVal)
+        return;
+
+    e->reg     = reg;
+    e->channel = channel;
+    e->oldVal  = oldVal;
+    e->newVal  = newVal;
+    events->push_back(*e);
+}
+
+void CStatusWatcher::compare(int index, const daqmux_status_t *now, uint64_t time, std::vector<status_event_t> *events)
+{
+    const daqmux_status_t *old = &_status[index];
+    status_event_t         e;
+
+    e.daqMux    = index;
+    e.time      = time;
+    e.timestamp = (uint64_t) now->timestampSec << 32 | now->timestampNsec;
+
+    compareReg(events, &e, statusDbgInputValid, -1, old->dbgInputValid, now->dbgInputValid);
+    compareReg(events, &e, statusDbgLinkReady,  -1, old->dbgLinkReady,  now->dbgLinkReady);
+    for(int i = 0; i < STREAMS_PER_DAQMUX; i++) {
+        compareReg(events, &e, statusStreamPause,    i, old->streamPause[i],    now->streamPause[i]);
+        compareReg(events, &e, statusStreamReady,    i, old->streamReady[i],    now->streamReady[i]);
+        compareReg(events, &e, statusStreamOverflow, i, old->streamOverflow[i], now->streamOverflow[i]);
+        compareReg(events, &e, statusStreamError,    i, old->streamError[i],    now->streamError[i]);
+        compareReg(events, &e, statusInputDataValid, i, old->inputDataValid[i], now->inputDataValid[i]);
+        compareReg(events, &e, statusStreamEnabled,  i, old->streamEnabled[i],  now->streamEnabled[i]);
+    }
+}
+
+void CStatusWatcher::scan(RegisterBatch batch)
+{
+    daqmux_status_t              now[MAX_DAQMUX_CNT];
+    std::vector<status_event_t>  events;
+    std::vector<StatusEventSink> sinks;
+    int                          rval;
+
+    try {
+        for(int i = 0; i < MAX_DAQMUX_CNT; i++)
+            if(_daqMuxMask & (1 << i)) _fw->getDaqMuxStatus(batch, &now[i], i);
+        rval = batch->wait();
+    } catch (CPSWError &e) {
+        batch->wait();
+        return;
+    }
+    if(rval)
+        return;
+
+    uint64_t time = streamMonotonicTime();
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        for(int i = 0; i < MAX_DAQMUX_CNT; i++) {
+            if(!(_daqMuxMask & (1 << i)))
+                continue;
+            if(_valid[i]) compare(i, &now[i], time, &events);
+            _status[i] = now[i];
+            _valid[i]  = true;
+        }
+        if(!events.empty()) sinks = _sinks;
+    }
+
+    /* deliver without the lock so sinks may call back into the watcher */
+    for(unsigned i = 0; i < events.size(); i++)
+        for(unsigned j = 0; j < sinks.size(); j++)
+            sinks[j]->processStatusEvent(&events[i]);
+}
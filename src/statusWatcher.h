@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STATUS_WATCHER_H
+#define _STATUS_WATCHER_H
+
+#include "atcaCommon.h"
+
+typedef enum {
+    statusDbgInputValid = 0,
+    statusDbgLinkReady,
+    statusStreamPause,
+    statusStreamReady,
+    statusStreamOverflow,
+    statusStreamError,
+    statusInputDataValid,
+    statusStreamEnabled,
+    statusRegisterCnt
+} status_register_t;
+
+typedef struct {
+    int                daqMux;
+    status_register_t  reg;
+    int                channel;       // -1 for DaqMux wide registers
+    uint32_t           oldVal;
+    uint32_t           newVal;
+    uint64_t           time;          // CLOCK_MONOTONIC [ns] of the scan which saw the change
+    uint64_t           timestamp;     // DaqMux Timestamp (sec << 32 | nsec) of that scan
+} status_event_t;
+
+const char *statusRegisterName(status_register_t reg);
+
+class IStatusEventSink;
+typedef shared_ptr<IStatusEventSink> StatusEventSink;
+
+/* Called from the watcher thread, once per changed register */
+class IStatusEventSink {
+public:
+    virtual void processStatusEvent(const status_event_t *event) = 0;
+    virtual ~IStatusEventSink() {}
+};
+
+class IStatusWatcher;
+typedef shared_ptr<IStatusWatcher> StatusWatcher;
+
+/* Watches the DaqMux status flags and publishes their transitions.
+ *
+ * Every period the watcher reads the status registers of the DaqMuxes in
+ * daqMuxMask in one register batch, compares them with the previous scan
+ * and sends an event per changed value to the subscribers. The first scan
+ * only sets the baseline; use getStatus() for the current values. Counters
+ * (TrigCount, Timestamp, FrameCnt) change all the time and are available
+ * through getStatus() but do not produce events. A scan with a failed
+ * read is discarded.
+ */
+class IStatusWatcher {
+public:
+    static StatusWatcher create(ATCACommonFw fw, uint32_t daqMuxMask, unsigned period);
+
+    virtual void subscribe(StatusEventSink sink)   = 0;
+    virtual void unsubscribe(StatusEventSink sink) = 0;
+    virtual void start() = 0;
+    virtual void stop()  = 0;
+    /* return -1 if no scan of this DaqMux succeeded yet */
+    virtual int  getStatus(daqmux_status_t *status, int index) = 0;
+    virtual ~IStatusWatcher() {}
+};
+
+#endif /* _STATUS_WATCHER_H */
@@ -0,0 +1,399 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include "streamDecimator.h"
+#include "streamSimd.h"
+
+static float blockSum(const float *x, uint64_t n)
+{
+    v8sf     acc = { 0 };
+    v8sf     v;
+    uint64_t i   = 0;
+    float    sum = 0.;
+
+    for(; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdLoad(&v, x + i);
+        acc += v;
+    }
+    for(int k = 0; k < SIMD_WIDTH; k++) sum += acc[k];
+    for(; i < n; i++) sum += x[i];
+
+    return sum;
+}
+
+static float dotProduct(const float *x, const float *h, uint64_t n)
+{
+    v8sf     acc = { 0 };
+    v8sf     a, b;
+    uint64_t i   = 0;
+    float    sum = 0.;
+
+    for(; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdLoad(&a, x + i);
+        simdLoad(&b, h + i);
+        acc += a * b;
+    }
+    for(int k = 0; k < SIMD_WIDTH; k++) sum += acc[k];
+    for(; i < n; i++) sum += x[i] * h[i];
+
+    return sum;
+}
+
+static void toFloat(float *out, const int32_t *in, uint64_t n)
+{
+    for(uint64_t i = 0; i < n; i++) out[i] = (float) in[i];
+}
+
+
+typedef enum {
+    decimBoxcar = 0,
+    decimCic,
+    decimFir
+} decim_filter_t;
+
+typedef struct {
+    decim_filter_t      filter;
+    int                 parent;
+    uint32_t            ratio;
+    uint32_t            order;
+    std::vector<float>  taps;           // FIR taps, time reversed
+    // filter state
+    uint32_t            count;          // boxcar/CIC: samples accumulated
+    double              sum;            // boxcar
+    uint64_t            next;           // FIR: input index of the next output
+    std::vector<float>  history;        // FIR: last taps-1 input samples
+    uint64_t            integ[DECIM_MAX_CIC_ORDER];
+    uint64_t            comb[DECIM_MAX_CIC_ORDER];
+    std::vector<float>  out;
+} decim_stage_t;
+
+typedef struct {
+    stream_format_t            format;
+    std::vector<decim_stage_t> stages;
+    std::vector<int32_t>       raw;
+    std::vector<float>         in;
+    std::atomic<uint64_t>      dropped;
+} decim_channel_t;
+
+typedef struct {
+    uint32_t             stream;
+    std::vector<uint8_t> data;
+} decim_job_t;
+
+typedef struct {
+    std::mutex                 lock;
+    std::condition_variable    cond;
+    std::deque<decim_job_t *>  queue;
+    std::vector<decim_job_t *> free;
+    std::thread                thread;
+} decim_worker_t;
+
+
+class CStreamDecimator : public IStreamDecimator {
+    protected:
+        decim_channel_t             _channel[MAX_DEBUG_STREAM];
+        std::vector<decim_worker_t *> _worker;
+        std::vector<decim_job_t>    _jobs;
+        std::vector<DecimatedSink>  _sinks;
+        std::atomic<bool>           _run;
+
+        int  addStage(uint32_t stream, const decim_stage_t &stage);
+        void workerLoop(decim_worker_t *w);
+        void processChannel(uint32_t stream, const uint8_t *data, uint64_t size);
+        void runBoxcar(decim_stage_t *s, const float *x, uint64_t n);
+        void runCic(decim_stage_t *s, const int32_t *x, uint64_t n);
+        void runFir(decim_stage_t *s, const float *x, uint64_t n);
+
+    public:
+        CStreamDecimator(unsigned workers, unsigned queueDepth);
+        virtual ~CStreamDecimator();
+
+        virtual void processFrame(const stream_frame_t *frame);
+
+        virtual void setFormat(uint32_t stream, const stream_format_t *format);
+        virtual int  addBoxcar(uint32_t stream, int parent, uint32_t ratio);
+        virtual int  addCic(uint32_t stream, uint32_t ratio, uint32_t order);
+        virtual int  addFir(uint32_t stream, int parent, uint32_t ratio, const float *taps, unsigned nTaps);
+        virtual void addOutputSink(DecimatedSink sink);
+
+        virtual void start();
+        virtual void stop();
+        virtual uint64_t getDroppedFrames(uint32_t stream);
+};
+
+StreamDecimator IStreamDecimator::create(unsigned workers, unsigned queueDepth)
+{
+    return StreamDecimator(new CStreamDecimator(workers, queueDepth));
+}
+
+CStreamDecimator::CStreamDecimator(unsigned workers, unsigned queueDepth) :
+    _jobs((workers ? workers : 1) * queueDepth),
+    _run(false)
+{
+    if(!workers) workers = 1;
+
+    for(unsigned i = 0; i < workers; i++) {
+        decim_worker_t *w = new decim_worker_t;
+        for(unsigned j = 0; j < queueDepth; j++) w->free.push_back(&_jobs[i * queueDepth + j]);
+        _worker.push_back(w);
+    }
+
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        memset(&_channel[i].format, 0, sizeof(stream_format_t));
+        _channel[i].dropped = 0;
+    }
+}
+
+CStreamDecimator::~CStreamDecimator()
+{
+    stop();
+    for(unsigned i = 0; i < _worker.size(); i++) delete _worker[i];
+}
+
+void CStreamDecimator::setFormat(uint32_t stream, const stream_format_t *format)
+{
+    _channel[stream].format = *format;
+}
+
+int CStreamDecimator::addStage(uint32_t stream, const decim_stage_t &stage)
+{
+    if(_run || stream >= MAX_DEBUG_STREAM || !stage.ratio)
+        return -1;
+    if(stage.parent < -1 || stage.parent >= (int) _channel[stream].stages.size())
+        return -1;
+
+    _channel[stream].stages.push_back(stage);
+    return _channel[stream].stages.size() - 1;
+}
+
+int CStreamDecimator::addBoxcar(uint32_t stream, int parent, uint32_t ratio)
+{
+    decim_stage_t s = decim_stage_t();
+
+    s.filter = decimBoxcar;
+    s.parent = parent;
+    s.ratio  = ratio;
+    return addStage(stream, s);
+}
+
+int CStreamDecimator::addCic(uint32_t stream, uint32_t ratio, uint32_t order)
+{
+    decim_stage_t s = decim_stage_t();
+    double        growth;
+
+    /* 32 bit input plus order*log2(ratio) bits of growth must fit the integrators */
+    growth = order * log2((double) ratio);
+    if(!order || order > DECIM_MAX_CIC_ORDER || growth > 32.)
+        return -1;
+
+    s.filter = decimCic;
+    s.parent = -1;
+    s.ratio  = ratio;
+    s.order  = order;
+    return addStage(stream, s);
+}
+
+int CStreamDecimator::addFir(uint32_t stream, int parent, uint32_t ratio, const float *taps, unsigned nTaps)
+{
+    decim_stage_t s = decim_stage_t();
+
+    if(!nTaps)
+        return -1;
+
+    s.filter = decimFir;
+    s.parent = parent;
+    s.ratio  = ratio;
+    s.taps.assign(taps, taps + nTaps);
+    std::reverse(s.taps.begin(), s.taps.end());
+    s.history.assign(nTaps - 1, 0.);
+    s.next   = ratio - 1;
+    return addStage(stream, s);
+}
+
+void CStreamDecimator::addOutputSink(DecimatedSink sink)
+{
+    if(!_run) _sinks.push_back(sink);
+}
+
+void CStreamDecimator::start()
+{
+    if(_run)
+        return;
+
+    _run = true;
+    for(unsigned i = 0; i < _worker.size(); i++)
+        _worker[i]->thread = std::thread(&CStreamDecimator::workerLoop, this, _worker[i]);
+}
+
+void CStreamDecimator::stop()
+{
+    if(!_run)
+        return;
+
+    for(unsigned i = 0; i < _worker.size(); i++) {
+        std::lock_guard<std::mutex> lock(_worker[i]->lock);
+        _run = false;
+        _worker[i]->cond.notify_one();
+    }
+    for(unsigned i = 0; i < _worker.size(); i++) _worker[i]->thread.join();
+}
+
+uint64_t CStreamDecimator::getDroppedFrames(uint32_t stream)
+{
+    return _channel[stream].dropped;
+}
+
+void CStreamDecimator::processFrame(const stream_frame_t *frame)
+{
+    if(!_run || frame->stream >= MAX_DEBUG_STREAM || _channel[frame->stream].stages.empty())
+        return;
+
+    decim_worker_t *w = _worker[frame->stream % _worker.size()];
+    decim_job_t    *job;
+    {
+        std::lock_guard<std::mutex> lock(w->lock);
+        if(w->free.empty()) {
+            _channel[frame->stream].dropped++;
+            return;
+        }
+        job = w->free.back();
+        w->free.pop_back();
+    }
+
+    job->stream = frame->stream;
+    job->data.assign(frame->data, frame->data + frame->size);
+
+    std::lock_guard<std::mutex> lock(w->lock);
+    w->queue.push_back(job);
+    w->cond.notify_one();
+}
+
+void CStreamDecimator::workerLoop(decim_worker_t *w)
+{
+    std::unique_lock<std::mutex> lock(w->lock);
+
+    while(1) {
+        while(_run && w->queue.empty()) w->cond.wait(lock);
+        if(!_run)
+            break;
+
+        decim_job_t *job = w->queue.front();
+        w->queue.pop_front();
+
+        lock.unlock();
+        processChannel(job->stream, job->data.data(), job->data.size());
+        lock.lock();
+
+        w->free.push_back(job);
+    }
+}
+
+void CStreamDecimator::processChannel(uint32_t stream, const uint8_t *data, uint64_t size)
+{
+    decim_channel_t *c = &_channel[stream];
+    stream_frame_t   frame;
+    uint64_t         n;
+
+    frame.stream      = stream;
+    frame.data        = data;
+    frame.size        = size;
+    frame.arrivalTime = 0;
+    frame.readyTime   = 0;
+
+    n = streamSampleCount(&frame, &c->format);
+    c->raw.resize(n);
+    c->in.resize(n);
+    n = decodeStreamSamples(&frame, &c->format, c->raw.data(), n);
+    toFloat(c->in.data(), c->raw.data(), n);
+
+    for(unsigned i = 0; i < c->stages.size(); i++) {
+        decim_stage_t *s = &c->stages[i];
+        const float   *x = s->parent < 0 ? c->in.data() : c->stages[s->parent].out.data();
+        uint64_t       m = s->parent < 0 ? n            : c->stages[s->parent].out.size();
+
+        s->out.clear();
+        switch(s->filter) {
+            case decimBoxcar: runBoxcar(s, x, m);            break;
+            case decimCic:    runCic(s, c->raw.data(), n);   break;
+            case decimFir:    runFir(s, x, m);               break;
+        }
+
+        if(s->out.empty())
+            continue;
+        for(unsigned k = 0; k < _sinks.size(); k++)
+            _sinks[k]->processSamples(stream, i, s->out.data(), s->out.size());
+    }
+}
+
+void CStreamDecimator::runBoxcar(decim_stage_t *s, const float *x, uint64_t n)
+{
+    uint64_t i = 0;
+
+    while(i < n) {
+        uint64_t take = s->ratio - s->count;
+        if(take > n - i) take = n - i;
+
+        s->sum   += blockSum(x + i, take);
+        s->count += take;
+        i        += take;
+
+        if(s->count == s->ratio) {
+            s->out.push_back(s->sum / s->ratio);
+            s->sum   = 0.;
+            s->count = 0;
+        }
+    }
+}
+
+void CStreamDecimator::runCic(decim_stage_t *s, const int32_t *x, uint64_t n)
+{
+    double gain = 1. / pow((double) s->ratio, (double) s->order);
+
+    /* integer arithmetic modulo 2^64; the comb stages cancel any wrap around */
+    for(uint64_t i = 0; i < n; i++) {
+        s->integ[0] += (uint64_t) (int64_t) x[i];
+        for(uint32_t k = 1; k < s->order; k++) s->integ[k] += s->integ[k-1];
+
+        if(++s->count < s->ratio)
+            continue;
+        s->count = 0;
+
+        uint64_t v = s->integ[s->order - 1];
+        for(uint32_t k = 0; k < s->order; k++) {
+            uint64_t t = v;
+            v         -= s->comb[k];
+            s->comb[k] = t;
+        }
+        s->out.push_back((float) ((int64_t) v * gain));
+    }
+}
+
+void CStreamDecimator::runFir(decim_stage_t *s, const float *x, uint64_t n)
+{
+    uint64_t keep = s->taps.size() - 1;
+
+    /* history holds the last taps-1 samples followed by the new block, so
+     * the window of the output at new sample j starts at history[j] */
+    s->history.insert(s->history.end(), x, x + n);
+    for(; s->next < n; s->next += s->ratio)
+        s->out.push_back(dotProduct(&s->history[s->next], s->taps.data(), s->taps.size()));
+    s->next -= n;
+    s->history.erase(s->history.begin(), s->history.end() - keep);
+}
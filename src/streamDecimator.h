@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_DECIMATOR_H
+#define _STREAM_DECIMATOR_H
+
+#include "streamFrame.h"
+
+#define DECIM_MAX_CIC_ORDER   6
+
+class IDecimatedSink;
+typedef shared_ptr<IDecimatedSink> DecimatedSink;
+
+/* Receives the samples of one decimator output. Called from the
+ * decimator worker threads; outputs of different streams may be
+ * delivered concurrently.
+ */
+class IDecimatedSink {
+public:
+    virtual void processSamples(uint32_t stream, int output, const float *samples, uint64_t count) = 0;
+    virtual ~IDecimatedSink() {}
+};
+
+class IStreamDecimator;
+typedef shared_ptr<IStreamDecimator> StreamDecimator;
+
+/* Host side multi-rate decimation of continuous mode streams.
+ *
+ * Attach the decimator to the streams with addStreamSink() and configure
+ * a tree of outputs per stream before start(). Each output decimates
+ * either the raw stream samples (parent = -1) or another output of the
+ * same stream, so e.g. 1 kHz and 10 Hz outputs are produced in one pass
+ * by chaining a 10 Hz stage behind the 1 kHz one. CIC stages work on the
+ * exact integer samples and therefore only take the raw stream as input.
+ *
+ * Frames are copied into per-worker queues; stream n is always handled by
+ * worker n % workers so filter state stays in order. Frames arriving at a
+ * full queue are dropped and counted.
+ */
+class IStreamDecimator : public IStreamFrameSink {
+public:
+    static StreamDecimator create(unsigned workers, unsigned queueDepth = 64);
+
+    virtual void setFormat(uint32_t stream, const stream_format_t *format) = 0;
+    /* return the output index, or -1 for an invalid configuration */
+    virtual int  addBoxcar(uint32_t stream, int parent, uint32_t ratio) = 0;
+    virtual int  addCic(uint32_t stream, uint32_t ratio, uint32_t order) = 0;
+    virtual int  addFir(uint32_t stream, int parent, uint32_t ratio, const float *taps, unsigned nTaps) = 0;
+    virtual void addOutputSink(DecimatedSink sink) = 0;
+
+    virtual void start() = 0;
+    virtual void stop()  = 0;
+    virtual uint64_t getDroppedFrames(uint32_t stream) = 0;
+};
+
+#endif /* _STREAM_DECIMATOR_H */
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+#include <time.h>
+
+#include "streamFrame.h"
+
+uint64_t streamMonotonicTime(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+int parseStreamHeader(const stream_frame_t *frame, daqmux_header_t *header)
+{
+    if(frame->size < DAQMUX_HEADER_SIZE)
+        return -1;
+
+    memcpy(header, frame->data, DAQMUX_HEADER_SIZE);
+    return 0;
+}
+
+uint64_t streamHeaderTimestamp(const daqmux_header_t *header)
+{
+    return ((uint64_t) header->timestampSec << 32) | header->timestampNsec;
+}
+
+const uint8_t *streamPayload(const stream_frame_t *frame, const stream_format_t *format, uint64_t *bytes)
+{
+    uint64_t offset = format->header ? DAQMUX_HEADER_SIZE : 0;
+
+    if(frame->size <= offset) {
+        *bytes = 0;
+        return frame->data + frame->size;
+    }
+
+    *bytes = frame->size - offset;
+    return frame->data + offset;
+}
+
+uint64_t streamSampleCount(const stream_frame_t *frame, const stream_format_t *format)
+{
+    uint64_t bytes;
+
+    streamPayload(frame, format, &bytes);
+    return format->dataWidth ? bytes / sizeof(int16_t) : bytes / sizeof(int32_t);
+}
+
+uint64_t decodeStreamSamples(const stream_frame_t *frame, const stream_format_t *format, int32_t *samples, uint64_t maxSamples)
+{
+    uint64_t       bytes;
+    const uint8_t *p = streamPayload(frame, format, &bytes);
+    uint64_t       n = streamSampleCount(frame, format);
+
+    if(n > maxSamples) n = maxSamples;
+
+    if(!format->dataWidth) {            /* 32 bit samples */
+        memcpy(samples, p, n * sizeof(int32_t));
+    } else if(format->sign) {           /* 16 bit, sign extended */
+        const int16_t *s = (const int16_t *) p;
+        for(uint64_t i = 0; i < n; i++) samples[i] = s[i];
+    } else {                            /* 16 bit, zero extended */
+        const uint16_t *s = (const uint16_t *) p;
+        for(uint64_t i = 0; i < n; i++) samples[i] = s[i];
+    }
+
+    return n;
+}
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_FRAME_H
+#define _STREAM_FRAME_H
+
+#include <cpsw_api_user.h>
+
+#include <stdint.h>
+
+#define MAX_DAQMUX_CNT        2
+#define MAX_DEBUG_STREAM      8
+#define STREAMS_PER_DAQMUX    4     // stream n carries channel n%4 of DaqMux n/4
+
+#define DAQMUX_HEADER_WORDS   8
+#define DAQMUX_HEADER_SIZE    (DAQMUX_HEADER_WORDS * sizeof(uint32_t))
+
+/* DaqMuxV2 packet header, present at the start of every frame when
+ * PacketHeaderEn is set.
+ */
+typedef struct {
+    uint32_t packetSize;      // word 0: packet length
+    uint32_t info;            // word 1: [7:0] channel index, remaining bits format flags
+    uint32_t timestampNsec;   // word 2
+    uint32_t timestampSec;    // word 3
+    uint32_t reserved[DAQMUX_HEADER_WORDS - 4];
+} daqmux_header_t;
+
+/* Sample format of a debug stream, as configured in its DaqMux */
+typedef struct {
+    uint32_t header;          // PacketHeaderEn
+    uint32_t dataWidth;       // FormatDataWidth: 0 = 32 bit, 1 = 16 bit
+    uint32_t sign;            // FormatSign: 0 = unsigned, 1 = signed
+} stream_format_t;
+
+/* One frame as returned by readStream(). data points into the reader's
+ * buffer and is only valid for the duration of processFrame().
+ */
+typedef struct {
+    uint32_t        stream;       // debug stream index
+    const uint8_t  *data;
+    uint64_t        size;         // bytes
+    uint64_t        arrivalTime;  // CLOCK_MONOTONIC [ns] when the read completed
+    uint64_t        readyTime;    // CLOCK_MONOTONIC [ns] when the frame became readable, 0 if unknown
+} stream_frame_t;
+
+class IStreamFrameSink;
+typedef shared_ptr<IStreamFrameSink> StreamFrameSink;
+
+/* Consumer attached to the stream read path with addStreamSink().
+ * processFrame() runs in the thread calling readStream() and must not
+ * block; sinks doing heavy work hand the frame to their own threads.
+ */
+class IStreamFrameSink {
+public:
+    virtual void processFrame(const stream_frame_t *frame) = 0;
+    virtual ~IStreamFrameSink() {}
+};
+
+uint64_t streamMonotonicTime(void);
+
+int      parseStreamHeader(const stream_frame_t *frame, daqmux_header_t *header);
+uint64_t streamHeaderTimestamp(const daqmux_header_t *header);   // sec << 32 | nsec
+const uint8_t *streamPayload(const stream_frame_t *frame, const stream_format_t *format, uint64_t *bytes);
+uint64_t streamSampleCount(const stream_frame_t *frame, const stream_format_t *format);
+uint64_t decodeStreamSamples(const stream_frame_t *frame, const stream_format_t *format, int32_t *samples, uint64_t maxSamples);
+
+#endif /* _STREAM_FRAME_H */
@@ -0,0 +1,291 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+#include <thread>
+
+#include "streamHistory.h"
+
+#define BLOCK_HEADER_SIZE  5        // first sample, delta width
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+/* worst case size of n compressed samples */
+static uint64_t compressBound(uint64_t n)
+{
+    uint64_t blocks = (n + HISTORY_BLOCK_SAMPLES - 1) / HISTORY_BLOCK_SAMPLES;
+    return blocks * (BLOCK_HEADER_SIZE + (HISTORY_BLOCK_SAMPLES * 33 + 7) / 8);
+}
+
+static uint64_t compressSamples(uint8_t *out, const int32_t *x, uint64_t n)
+{
+    uint8_t *p = out;
+
+    for(uint64_t b = 0; b < n; b += HISTORY_BLOCK_SAMPLES) {
+        uint64_t m     = n - b < HISTORY_BLOCK_SAMPLES ? n - b : HISTORY_BLOCK_SAMPLES;
+        uint64_t all   = 0;
+        unsigned width = 0;
+
+        for(uint64_t i = 1; i < m; i++) all |= zigzag((int64_t) x[b + i] - x[b + i - 1]);
+        while(all >> width) width++;
+
+        memcpy(p, &x[b], sizeof(int32_t));
+        p[4] = width;
+        p   += BLOCK_HEADER_SIZE;
+        if(!width)
+            continue;
+
+        uint64_t acc = 0;
+        unsigned bits = 0;
+        for(uint64_t i = 1; i < m; i++) {
+            acc  |= zigzag((int64_t) x[b + i] - x[b + i - 1]) << bits;
+            bits += width;
+            for(; bits >= 8; bits -= 8, acc >>= 8) *p++ = acc;
+        }
+        if(bits) *p++ = acc;
+    }
+
+    return p - out;
+}
+
+static void decompressSamples(int32_t *x, const uint8_t *p, uint64_t n)
+{
+    for(uint64_t b = 0; b < n; b += HISTORY_BLOCK_SAMPLES) {
+        uint64_t m     = n - b < HISTORY_BLOCK_SAMPLES ? n - b : HISTORY_BLOCK_SAMPLES;
+        unsigned width = p[4];
+        uint64_t mask  = (1ULL << width) - 1;
+        uint64_t acc   = 0;
+        unsigned bits  = 0;
+
+        memcpy(&x[b], p, sizeof(int32_t));
+        p += BLOCK_HEADER_SIZE;
+
+        for(uint64_t i = 1; i < m; i++) {
+            for(; bits < width; bits += 8) acc |= (uint64_t) *p++ << bits;
+            x[b + i] = x[b + i - 1] + unzigzag(acc & mask);
+            acc  >>= width;
+            bits  -= width;
+        }
+    }
+}
+
+
+typedef struct {
+    uint32_t  stream;
+    uint64_t  arrivalTime;
+    uint64_t  timestamp;
+    uint64_t  samples;
+    uint64_t  offset;         // in the arena
+    uint64_t  bytes;
+} history_chunk_t;
+
+typedef struct {
+    stream_format_t       format;
+    std::vector<int32_t>  raw;
+    std::vector<uint8_t>  packed;
+} history_stream_t;
+
+class CStreamHistory : public IStreamHistory {
+    protected:
+        std::mutex                   _lock;
+        std::vector<uint8_t>         _arena;
+        uint64_t                     _head;
+        std::vector<history_chunk_t> _chunks;       // ring, oldest at _first
+        uint64_t                     _first;
+        uint64_t                     _count;
+        unsigned                     _workers;
+        history_stats_t              _stats;
+        history_stream_t             _stream[MAX_DEBUG_STREAM];
+
+        history_chunk_t *chunk(uint64_t i) { return &_chunks[(_first + i) % _chunks.size()]; }
+        void evictFront();
+        uint64_t allocate(uint64_t bytes);
+
+    public:
+        CStreamHistory(uint64_t budget, unsigned workers, uint64_t maxFrames);
+
+        virtual void setFormat(uint32_t stream, const stream_format_t *format);
+        virtual void processFrame(const stream_frame_t *frame);
+        virtual int  getWindow(uint32_t stream, uint64_t start, uint64_t end,
+                               std::vector<history_frame_t> *frames, std::vector<int32_t> *samples);
+        virtual void getStats(history_stats_t *stats);
+        virtual void clear();
+};
+
+StreamHistory IStreamHistory::create(uint64_t budget, unsigned workers, uint64_t maxFrames)
+{
+    if(!maxFrames) maxFrames = budget / HISTORY_FRAME_BYTES;
+    return StreamHistory(new CStreamHistory(budget, workers ? workers : 1, maxFrames ? maxFrames : 1));
+}
+
+CStreamHistory::CStreamHistory(uint64_t budget, unsigned workers, uint64_t maxFrames) :
+    _arena(budget),
+    _head(0),
+    _chunks(maxFrames),
+    _first(0),
+    _count(0),
+    _workers(workers)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++)
+        memset(&_stream[i].format, 0, sizeof(stream_format_t));
+}
+
+void CStreamHistory::setFormat(uint32_t stream, const stream_format_t *format)
+{
+    _stream[stream].format = *format;
+}
+
+void CStreamHistory::evictFront()
+{
+    _stats.frames--;
+    _stats.evicted++;
+    _stats.rawBytes    -= chunk(0)->samples * sizeof(int32_t);
+    _stats.storedBytes -= chunk(0)->bytes;
+    _first = (_first + 1) % _chunks.size();
+    _count--;
+}
+
+/* chunks are laid out in arrival order around the arena, so the ones in
+ * the way of a new chunk are always the oldest */
+uint64_t CStreamHistory::allocate(uint64_t bytes)
+{
+    if(_head + bytes > _arena.size()) {
+        while(_count && chunk(0)->offset >= _head) evictFront();
+        _head = 0;
+    }
+    while(_count && chunk(0)->offset >= _head && chunk(0)->offset < _head + bytes)
+        evictFront();
+    if(_count == _chunks.size())
+        evictFront();
+
+    uint64_t offset = _head;
+    _head += bytes;
+    return offset;
+}
+
+void CStreamHistory::processFrame(const stream_frame_t *frame)
+{
+    if(frame->stream >= MAX_DEBUG_STREAM)
+        return;
+
+    history_stream_t *s = &_stream[frame->stream];
+    history_chunk_t   c;
+    daqmux_header_t   header;
+
+    /* one reader thread per stream, compress outside the lock */
+    c.samples = streamSampleCount(frame, &s->format);
+    s->raw.resize(c.samples);
+    s->packed.resize(compressBound(c.samples));
+    c.samples = decodeStreamSamples(frame, &s->format, s->raw.data(), c.samples);
+    c.bytes   = compressSamples(s->packed.data(), s->raw.data(), c.samples);
+
+    c.stream      = frame->stream;
+    c.arrivalTime = frame->arrivalTime;
+    c.timestamp   = (s->format.header && !parseStreamHeader(frame, &header)) ? streamHeaderTimestamp(&header) : 0;
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if(c.bytes > _arena.size()) {
+        _stats.rejected++;
+        return;
+    }
+
+    c.offset = allocate(c.bytes);
+    memcpy(_arena.data() + c.offset, s->packed.data(), c.bytes);
+    *chunk(_count++) = c;
+
+    _stats.frames++;
+    _stats.rawBytes    += c.samples * sizeof(int32_t);
+    _stats.storedBytes += c.bytes;
+}
+
+int CStreamHistory::getWindow(uint32_t stream, uint64_t start, uint64_t end,
+                              std::vector<history_frame_t> *frames, std::vector<int32_t> *samples)
+{
+    std::vector<uint8_t>  packed;
+    std::vector<uint64_t> packedOffset;
+    uint64_t              total = 0;
+
+    if(stream >= MAX_DEBUG_STREAM)
+        return -1;
+
+    bool byTimestamp = _stream[stream].format.header;
+
+    frames->clear();
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        for(uint64_t i = 0; i < _count; i++) {
+            const history_chunk_t *c = chunk(i);
+            uint64_t               t = byTimestamp ? c->timestamp : c->arrivalTime;
+            if(c->stream != stream || (byTimestamp && !t) || t < start || t > end)
+                continue;
+
+            history_frame_t f;
+            f.stream      = c->stream;
+            f.arrivalTime = c->arrivalTime;
+            f.timestamp   = c->timestamp;
+            f.samples     = c->samples;
+            f.offset      = total;
+            frames->push_back(f);
+            packedOffset.push_back(packed.size());
+            packed.insert(packed.end(), _arena.data() + c->offset, _arena.data() + c->offset + c->bytes);
+            total += c->samples;
+        }
+    }
+
+    samples->resize(total);
+
+    /* frames are independent, split them evenly over the workers */
+    unsigned                 workers = _workers < frames->size() ? _workers : frames->size();
+    std::vector<std::thread> threads;
+
+    for(unsigned w = 0; w < workers; w++) {
+        threads.push_back(std::thread([&, w] {
+            for(unsigned i = w; i < frames->size(); i += workers)
+                decompressSamples(samples->data() + (*frames)[i].offset,
+                                  packed.data() + packedOffset[i], (*frames)[i].samples);
+        }));
+    }
+    for(unsigned w = 0; w < threads.size(); w++) threads[w].join();
+
+    return frames->size();
+}
+
+void CStreamHistory::getStats(history_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    *stats = _stats;
+    stats->oldest = _count ? chunk(0)->arrivalTime : 0;
+}
+
+void CStreamHistory::clear()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _first = 0;
+    _count = 0;
+    _head  = 0;
+    _stats.frames      = 0;
+    _stats.rawBytes    = 0;
+    _stats.storedBytes = 0;
+}
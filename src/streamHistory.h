@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_HISTORY_H
+#define _STREAM_HISTORY_H
+
+#include <vector>
+
+#include "streamFrame.h"
+
+#define HISTORY_BLOCK_SAMPLES  128
+#define HISTORY_FRAME_BYTES    1024     // budget per frame when maxFrames is not given
+
+typedef struct {
+    uint32_t  stream;
+    uint64_t  arrivalTime;    // CLOCK_MONOTONIC [ns]
+    uint64_t  timestamp;      // header timestamp (sec << 32 | nsec), 0 without header
+    uint64_t  samples;
+    uint64_t  offset;         // first sample of this frame in the window samples
+} history_frame_t;
+
+typedef struct {
+    uint64_t  frames;         // frames currently held
+    uint64_t  evicted;        // frames dropped to make room or above maxFrames
+    uint64_t  rejected;       // frames larger than the whole budget
+    uint64_t  rawBytes;       // decoded size of the frames held
+    uint64_t  storedBytes;    // compressed size of the frames held
+    uint64_t  oldest;         // arrivalTime of the oldest frame held
+} history_stats_t;
+
+class IStreamHistory;
+typedef shared_ptr<IStreamHistory> StreamHistory;
+
+/* Compressed history of the debug streams in a fixed amount of memory.
+ *
+ * Every frame is compressed in the reader thread, in blocks of
+ * HISTORY_BLOCK_SAMPLES: the first sample verbatim, then the zigzag coded
+ * deltas bit-packed at the width of the largest one. Slowly varying ADC
+ * data typically needs a few bits per sample. Compressed frames go into
+ * one arena of budget bytes; the oldest frames are evicted when it fills.
+ * The frame index is a ring of maxFrames entries, budget /
+ * HISTORY_FRAME_BYTES if 0, so small frames cannot grow it without bound;
+ * the oldest frame is evicted when it is full as well.
+ *
+ * getWindow() decompresses all frames of a stream within [start, end] on
+ * up to workers threads. For streams whose format has a header, start and
+ * end are header timestamps (sec << 32 | nsec) and frames without a valid
+ * header are left out; for the others they are arrival times.
+ */
+class IStreamHistory : public IStreamFrameSink {
+public:
+    static StreamHistory create(uint64_t budget, unsigned workers, uint64_t maxFrames = 0);
+
+    virtual void setFormat(uint32_t stream, const stream_format_t *format) = 0;
+    virtual int  getWindow(uint32_t stream, uint64_t start, uint64_t end,
+                           std::vector<history_frame_t> *frames, std::vector<int32_t> *samples) = 0;
+    virtual void getStats(history_stats_t *stats) = 0;
+    virtual void clear() = 0;
+};
+
+#endif /* _STREAM_HISTORY_H */
@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "streamReader.h"
+
+#define READ_ERROR_BACKOFF_MIN  1000        // [us]
+#define READ_ERROR_BACKOFF_MAX  1000000
+
+typedef struct {
+    std::mutex         lock;
+    uint64_t           frames;
+    uint64_t           polledFrames;
+    uint64_t           blockedFrames;
+    uint64_t           errors;
+    CLatencyHistogram  latency;
+    CLatencyHistogram  wakeup;
+    CLatencyHistogram  pollGap;
+} reader_stats_t;
+
+/* Attached to every stream read, sees readyTime and arrivalTime of each
+ * frame in the reader thread */
+class CReaderLatencySink : public IStreamFrameSink {
+    protected:
+        reader_stats_t *_s;
+
+    public:
+        CReaderLatencySink(reader_stats_t *s) : _s(s) {}
+
+        virtual void processFrame(const stream_frame_t *frame)
+        {
+            if(!frame->readyTime || frame->arrivalTime < frame->readyTime)
+                return;
+            std::lock_guard<std::mutex> lock(_s->lock);
+            _s->latency.add(frame->arrivalTime - frame->readyTime);
+        }
+};
+
+class CStreamReader : public IStreamReader {
+    protected:
+        ATCADebugStream          _stream;
+        stream_reader_config_t   _config;
+        std::mutex               _lock;
+        std::thread              _thread[MAX_DEBUG_STREAM];
+        StreamFrameSink          _latencySink[MAX_DEBUG_STREAM];
+        std::atomic<bool>        _run;
+        reader_stats_t           _stats[MAX_DEBUG_STREAM];
+
+        void setupThread(uint32_t index);
+        void readerLoop(uint32_t index);
+
+    public:
+        CStreamReader(ATCADebugStream stream, const stream_reader_config_t *config);
+        virtual ~CStreamReader();
+
+        virtual void start();
+        virtual void stop();
+        virtual void getStats(stream_reader_stats_t *stats, uint32_t index);
+        virtual void resetStats(uint32_t index);
+};
+
+StreamReader IStreamReader::create(ATCADebugStream stream, const stream_reader_config_t *config)
+{
+    return StreamReader(new CStreamReader(stream, config));
+}
+
+CStreamReader::CStreamReader(ATCADebugStream stream, const stream_reader_config_t *config) :
+    _stream(stream),
+    _config(*config),
+    _run(false)
+{
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) resetStats(i);
+}
+
+CStreamReader::~CStreamReader()
+{
+    stop();
+}
+
+void CStreamReader::start()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(_run)
+        return;
+
+    _run = true;
+    for(uint32_t i = 0; i < MAX_DEBUG_STREAM; i++) {
+        if(!(_config.streamMask & (1 << i)))
+            continue;
+        _latencySink[i] = StreamFrameSink(new CReaderLatencySink(&_stats[i]));
+        _stream->addStreamSink(_latencySink[i], i);
+        _thread[i] = std::thread(&CStreamReader::readerLoop, this, i);
+    }
+}
+
+void CStreamReader::stop()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(!_run)
+        return;
+
+    _run = false;
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        if(_thread[i].joinable()) _thread[i].join();
+        if(_latencySink[i]) _stream->removeStreamSink(_latencySink[i], i);
+        _latencySink[i].reset();
+    }
+}
+
+void CStreamReader::setupThread(uint32_t index)
+{
+    int err;
+
+    if(_config.cpu[index] >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(_config.cpu[index], &set);
+        if((err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)))
+            fprintf(stderr, "IStreamReader: stream %u cannot be pinned to cpu %d (%s)\n",
+                    index, _config.cpu[index], strerror(err));
+    }
+
+    if(_config.priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = _config.priority;
+        if((err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)))
+            fprintf(stderr, "IStreamReader: stream %u cannot run SCHED_FIFO %d (%s)\n",
+                    index, _config.priority, strerror(err));
+    }
+}
+
+void CStreamReader::readerLoop(uint32_t index)
+{
+    std::vector<uint8_t> buf(_config.maxFrameSize);
+    reader_stats_t      *s         = &_stats[index];
+    uint64_t             blockUs   = _config.blockTimeout;
+    uint64_t             spinNs    = (uint64_t) _config.spinTime * 1000;
+    uint64_t             lastFrame = 0;
+    uint64_t             emptyPoll = 0;     // return of the last empty poll, 0: last read was no empty poll
+    unsigned             failed    = 0;     // consecutive read errors
+
+    setupThread(index);
+
+    while(_run) {
+        uint64_t before = streamMonotonicTime();
+        bool     poll   = (_config.mode == readerBusyPoll) ||
+                          (_config.mode == readerSpinThenBlock && before - lastFrame < spinNs);
+        int64_t  got;
+
+        try {
+            got = _stream->readStream(index, buf.data(), buf.size(), CTimeout(poll ? 0 : blockUs));
+        } catch (CPSWError &e) {
+            {
+                std::lock_guard<std::mutex> lock(s->lock);
+                s->errors++;
+            }
+            if(!failed)
+                fprintf(stderr, "IStreamReader: stream %u read failed (%s), backing off\n", index, e.getInfo().c_str());
+            uint64_t backoff = (uint64_t) READ_ERROR_BACKOFF_MIN << (failed < 10 ? failed : 10);
+            if(backoff > READ_ERROR_BACKOFF_MAX) backoff = READ_ERROR_BACKOFF_MAX;
+            failed++;
+            lastFrame = 0;
+            emptyPoll = 0;
+            std::this_thread::sleep_for(std::chrono::microseconds(backoff));
+            continue;
+        }
+        failed = 0;
+
+        uint64_t after = streamMonotonicTime();
+        std::lock_guard<std::mutex> lock(s->lock);
+
+        if(got > 0) {
+            s->frames++;
+            if(poll) s->polledFrames++;
+            else     s->blockedFrames++;
+            if(poll && emptyPoll) s->pollGap.add(after - emptyPoll);
+            lastFrame = after;
+        } else if(!poll && after - before > blockUs * 1000) {
+            s->wakeup.add(after - before - blockUs * 1000);
+        }
+        emptyPoll = (poll && got <= 0) ? after : 0;
+    }
+}
+
+void CStreamReader::getStats(stream_reader_stats_t *stats, uint32_t index)
+{
+    reader_stats_t *s = &_stats[index];
+    std::lock_guard<std::mutex> lock(s->lock);
+
+    stats->frames        = s->frames;
+    stats->polledFrames  = s->polledFrames;
+    stats->blockedFrames = s->blockedFrames;
+    stats->errors        = s->errors;
+    s->latency.getReport(&stats->latency);
+    s->wakeup.getReport(&stats->wakeup);
+    s->pollGap.getReport(&stats->pollGap);
+}
+
+void CStreamReader::resetStats(uint32_t index)
+{
+    reader_stats_t *s = &_stats[index];
+    std::lock_guard<std::mutex> lock(s->lock);
+
+    s->frames        = 0;
+    s->polledFrames  = 0;
+    s->blockedFrames = 0;
+    s->errors        = 0;
+    s->latency.reset();
+    s->wakeup.reset();
+    s->pollGap.reset();
+}
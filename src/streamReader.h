@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_READER_H
+#define _STREAM_READER_H
+
+#include "debugStream.h"
+#include "latencyHistogram.h"
+
+typedef enum {
+    readerBlock = 0,        // readStream() with blockTimeout
+    readerBusyPoll,         // readStream() with a zero timeout, never sleeps
+    readerSpinThenBlock     // poll for spinTime after each frame, then block
+} reader_mode_t;
+
+typedef struct {
+    uint32_t       streamMask;              // one reader thread per stream
+    reader_mode_t  mode;
+    uint32_t       spinTime;                // readerSpinThenBlock [us]
+    uint32_t       blockTimeout;            // timeout of blocking reads [us]
+    int            priority;                // SCHED_FIFO priority, 0: keep SCHED_OTHER
+    int            cpu[MAX_DEBUG_STREAM];   // core of each reader, -1: not pinned
+    uint64_t       maxFrameSize;            // bytes
+} stream_reader_config_t;
+
+typedef struct {
+    uint64_t          frames;
+    uint64_t          polledFrames;     // frames found by a zero timeout read
+    uint64_t          blockedFrames;    // frames received by a blocking read
+    uint64_t          errors;           // reads that failed with a CPSW error
+    latency_report_t  latency;          // frame readable until readStream() returned it [ns]
+    latency_report_t  wakeup;           // blocking reads: return after the timeout expired [ns]
+    latency_report_t  pollGap;          // polled frames: last empty poll to the read returning the frame [ns]
+} stream_reader_stats_t;
+
+class IStreamReader;
+typedef shared_ptr<IStreamReader> StreamReader;
+
+/* Reader threads for the debug streams of any ATCADebugStream, hardware or
+ * replay. Frames are delivered through the stream sinks, attach consumers
+ * with addStreamSink() before start().
+ *
+ * Busy polling keeps the thread runnable all the time and avoids the
+ * scheduler wakeup on frame arrival; pin such readers to isolated cores.
+ *
+ * CPSW does not timestamp received frames, so on hardware the latency of
+ * a frame is bounded per mode instead:
+ *   wakeup   blocking reads which timed out, how late the thread ran
+ *            after its timeout expired: the scheduler wakeup cost a
+ *            blocked reader also pays when a frame arrives.
+ *   pollGap  frames found by polling, time from the previous, empty poll
+ *            to the return of the read: an upper bound of how long the
+ *            frame waited, including preemption of the poll loop.
+ * The latency histogram measures from the readyTime a stream reports to
+ * the return of readStream(); only replays report it. Failing to set the
+ * affinity or priority is reported and the reader runs anyway. A reader
+ * whose reads keep failing backs off, from 1 ms up to 1 s between
+ * attempts.
+ */
+class IStreamReader {
+public:
+    static StreamReader create(ATCADebugStream stream, const stream_reader_config_t *config);
+
+    virtual void start() = 0;
+    virtual void stop()  = 0;
+    virtual void getStats(stream_reader_stats_t *stats, uint32_t index) = 0;
+    virtual void resetStats(uint32_t index) = 0;
+    virtual ~IStreamReader() {}
+};
+
+#endif /* _STREAM_READER_H */
@@ -0,0 +1,375 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "streamReplay.h"
+
+#define CAPTURE_FILE_BUFFER  (4 << 20)
+
+class CStreamRecorder : public IStreamRecorder {
+    protected:
+        std::mutex   _lock;
+        FILE        *_fp;
+        uint64_t     _frames;
+        uint64_t     _bytes;
+
+    public:
+        CStreamRecorder(FILE *fp);
+        virtual ~CStreamRecorder();
+
+        virtual void     processFrame(const stream_frame_t *frame);
+        virtual void     close();
+        virtual uint64_t getFrames();
+        virtual uint64_t getBytes();
+};
+
+StreamRecorder IStreamRecorder::create(const char *fileName, const stream_format_t format[MAX_DEBUG_STREAM])
+{
+    stream_capture_header_t header;
+    FILE                   *fp;
+
+    if(!(fp = fopen(fileName, "wb"))) {
+        fprintf(stderr, "IStreamRecorder: cannot create %s\n", fileName);
+        return StreamRecorder();
+    }
+    setvbuf(fp, NULL, _IOFBF, CAPTURE_FILE_BUFFER);
+
+    header.magic   = STREAM_CAPTURE_MAGIC;
+    header.version = STREAM_CAPTURE_VERSION;
+    memcpy(header.format, format, sizeof(header.format));
+    if(fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fprintf(stderr, "IStreamRecorder: cannot write %s\n", fileName);
+        fclose(fp);
+        return StreamRecorder();
+    }
+
+    return StreamRecorder(new CStreamRecorder(fp));
+}
+
+CStreamRecorder::CStreamRecorder(FILE *fp) :
+    _fp(fp),
+    _frames(0),
+    _bytes(0)
+{
+}
+
+CStreamRecorder::~CStreamRecorder()
+{
+    close();
+}
+
+void CStreamRecorder::processFrame(const stream_frame_t *frame)
+{
+    stream_capture_record_t rec;
+
+    rec.arrivalTime = frame->arrivalTime;
+    rec.stream      = frame->stream;
+    rec.size        = frame->size;
+
+    std::lock_guard<std::mutex> lock(_lock);
+    if(!_fp)
+        return;
+    if(fwrite(&rec, sizeof(rec), 1, _fp) != 1 || fwrite(frame->data, frame->size, 1, _fp) != 1) {
+        fprintf(stderr, "IStreamRecorder: write error, capture stopped\n");
+        fclose(_fp);
+        _fp = NULL;
+        return;
+    }
+    _frames++;
+    _bytes += frame->size;
+}
+
+void CStreamRecorder::close()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(_fp) fclose(_fp);
+    _fp = NULL;
+}
+
+uint64_t CStreamRecorder::getFrames()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _frames;
+}
+
+uint64_t CStreamRecorder::getBytes()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _bytes;
+}
+
+
+typedef struct {
+    std::vector<uint8_t>  data;
+    uint64_t              readyTime;    // CLOCK_MONOTONIC [ns] when queued
+} replay_frame_t;
+
+typedef struct {
+    std::deque<replay_frame_t>        queue;
+    uint64_t                          delivered;    // frames queued since start
+    uint64_t                          base;         // delivered at the last reset
+    uint64_t                          dropped;      // frames dropped at a full queue since start
+    uint64_t                          droppedBase;  // dropped at the last reset
+} replay_stream_t;
+
+class CStreamReplay : public IStreamReplay {
+    protected:
+        FILE                     *_fp;
+        long                      _dataStart;
+        stream_capture_header_t   _header;
+        double                    _speed;
+        bool                      _loop;
+        unsigned                  _queueDepth;
+        std::mutex                _lock;
+        std::condition_variable   _cond;
+        std::thread               _thread;
+        bool                      _run;
+        bool                      _eof;
+        replay_stream_t           _stream[MAX_DEBUG_STREAM];
+        CDebugStreamDispatch      _dispatch;
+
+        void loaderLoop();
+
+    public:
+        CStreamReplay(FILE *fp, const stream_capture_header_t *header, double speed, bool loop, unsigned queueDepth);
+        virtual ~CStreamReplay();
+
+        virtual void createStreams(ConstPath p, const char *prefix);
+        virtual int64_t readStream(uint32_t index, uint8_t *buf, uint64_t size, CTimeout timeout);
+        virtual void getStreamStats(stream_stats_t *stats, uint32_t index);
+        virtual void getStreamLoss(stream_loss_t *loss, uint32_t index);
+        virtual void resetStreamStats(uint32_t index);
+        virtual void getStreamFormat(stream_format_t *format, uint32_t index);
+        virtual void addStreamSink(StreamFrameSink sink, uint32_t index);
+        virtual void removeStreamSink(StreamFrameSink sink, uint32_t index);
+        virtual void stop();
+        virtual bool done();
+};
+
+StreamReplay IStreamReplay::create(const char *fileName, double speed, bool loop, unsigned queueDepth)
+{
+    stream_capture_header_t header;
+    FILE                   *fp;
+
+    if(!(fp = fopen(fileName, "rb"))) {
+        fprintf(stderr, "IStreamReplay: cannot open %s\n", fileName);
+        return StreamReplay();
+    }
+    setvbuf(fp, NULL, _IOFBF, CAPTURE_FILE_BUFFER);
+
+    if(fread(&header, sizeof(header), 1, fp) != 1 ||
+       header.magic != STREAM_CAPTURE_MAGIC || header.version != STREAM_CAPTURE_VERSION) {
+        fprintf(stderr, "IStreamReplay: %s is not a stream capture\n", fileName);
+        fclose(fp);
+        return StreamReplay();
+    }
+
+    return StreamReplay(new CStreamReplay(fp, &header, speed, loop, queueDepth ? queueDepth : 1));
+}
+
+CStreamReplay::CStreamReplay(FILE *fp, const stream_capture_header_t *header, double speed, bool loop, unsigned queueDepth) :
+    _fp(fp),
+    _dataStart(ftell(fp)),
+    _header(*header),
+    _speed(speed),
+    _loop(loop),
+    _queueDepth(queueDepth),
+    _run(false),
+    _eof(false)
+{
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        _stream[i].delivered   = 0;
+        _stream[i].base        = 0;
+        _stream[i].dropped     = 0;
+        _stream[i].droppedBase = 0;
+    }
+}
+
+CStreamReplay::~CStreamReplay()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _run = false;
+        _cond.notify_all();
+    }
+    if(_thread.joinable()) _thread.join();
+    fclose(_fp);
+}
+
+void CStreamReplay::createStreams(ConstPath, const char *)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(_run || _eof)
+        return;
+
+    _run    = true;
+    _thread = std::thread(&CStreamReplay::loaderLoop, this);
+}
+
+void CStreamReplay::loaderLoop()
+{
+    stream_capture_record_t rec;
+    uint64_t                first = 0, start = 0;
+    bool                    timed = false;
+
+    while(1) {
+        if(fread(&rec, sizeof(rec), 1, _fp) != 1) {
+            if(_loop && !fseek(_fp, _dataStart, SEEK_SET)) {
+                timed = false;
+                continue;
+            }
+            break;
+        }
+
+        std::vector<uint8_t> frame(rec.size);
+        if((rec.size && fread(frame.data(), rec.size, 1, _fp) != 1) || rec.stream >= MAX_DEBUG_STREAM)
+            break;
+
+        std::unique_lock<std::mutex> lock(_lock);
+
+        if(_speed > 0.) {
+            if(!timed) {
+                first = rec.arrivalTime;
+                start = streamMonotonicTime();
+                timed = true;
+            }
+            uint64_t target = start + (uint64_t) ((rec.arrivalTime - first) / _speed);
+            std::chrono::steady_clock::time_point due((std::chrono::nanoseconds(target)));
+            while(_run && _cond.wait_until(lock, due) != std::cv_status::timeout)
+                ;
+        }
+        if(!_run)
+            return;
+
+        replay_stream_t *s = &_stream[rec.stream];
+        if(_speed > 0. && s->queue.size() >= _queueDepth) {
+            s->dropped++;       /* the firmware drops a stream the host does not keep up with */
+            continue;
+        }
+        while(_run && s->queue.size() >= _queueDepth) _cond.wait(lock);
+        if(!_run)
+            return;
+
+        s->queue.push_back(replay_frame_t());
+        s->queue.back().data.swap(frame);
+        s->queue.back().readyTime = streamMonotonicTime();
+        s->delivered++;
+        _cond.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    _eof = true;
+    _cond.notify_all();
+}
+
+int64_t CStreamReplay::readStream(uint32_t index, uint8_t *buf, uint64_t size, CTimeout timeout)
+{
+    replay_stream_t *s = &_stream[index];
+    int64_t          got = 0;
+    uint64_t         readyTime = 0;
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        if(timeout.isIndefinite()) {
+            while(s->queue.empty() && !_eof) _cond.wait(lock);
+        } else if(!timeout.isNone()) {
+            _cond.wait_for(lock, std::chrono::microseconds(timeout.getUs()),
+                           [s, this] { return !s->queue.empty() || _eof; });
+        }
+
+        if(!s->queue.empty()) {
+            replay_frame_t *f = &s->queue.front();
+            got       = f->data.size() < size ? f->data.size() : size;
+            readyTime = f->readyTime;
+            memcpy(buf, f->data.data(), got);
+            s->queue.pop_front();
+            _cond.notify_all();
+        }
+    }
+
+    if(got > 0 || !timeout.isNone())
+        _dispatch.frameDone(index, buf, got, streamMonotonicTime(), readyTime);
+    return got;
+}
+
+void CStreamReplay::getStreamStats(stream_stats_t *stats, uint32_t index)
+{
+    _dispatch.getStats(stats, index);
+}
+
+void CStreamReplay::getStreamLoss(stream_loss_t *loss, uint32_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        loss->hwFrames = _stream[index].delivered - _stream[index].base;
+        loss->pause    = _stream[index].queue.size() >= _queueDepth;
+        loss->overflow = _stream[index].dropped - _stream[index].droppedBase;
+    }
+    loss->hostFrames = _dispatch.getHostFrames(index);
+    loss->lostFrames = (int64_t) loss->hwFrames - (int64_t) loss->hostFrames;
+}
+
+void CStreamReplay::resetStreamStats(uint32_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stream[index].base        = _stream[index].delivered;
+        _stream[index].droppedBase = _stream[index].dropped;
+    }
+    _dispatch.resetStats(index);
+}
+
+void CStreamReplay::getStreamFormat(stream_format_t *format, uint32_t index)
+{
+    *format = _header.format[index];
+}
+
+void CStreamReplay::addStreamSink(StreamFrameSink sink, uint32_t index)
+{
+    _dispatch.addSink(sink, index);
+}
+
+void CStreamReplay::removeStreamSink(StreamFrameSink sink, uint32_t index)
+{
+    _dispatch.removeSink(sink, index);
+}
+
+void CStreamReplay::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _run = false;
+        _cond.notify_all();
+    }
+    if(_thread.joinable()) _thread.join();
+
+    /* readers see the end of the file */
+    std::lock_guard<std::mutex> lock(_lock);
+    _eof = true;
+    _cond.notify_all();
+}
+
+bool CStreamReplay::done()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if(!_eof)
+        return false;
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++)
+        if(!_stream[i].queue.empty()) return false;
+    return true;
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_REPLAY_H
+#define _STREAM_REPLAY_H
+
+#include "debugStream.h"
+
+#define STREAM_CAPTURE_MAGIC    0x41545243   /* "ATRC" */
+#define STREAM_CAPTURE_VERSION  1
+
+/* Capture file layout, host byte order: one header, then for every frame a
+ * record header followed by size bytes of raw frame data.
+ */
+typedef struct {
+    uint32_t        magic;
+    uint32_t        version;
+    stream_format_t format[MAX_DEBUG_STREAM];
+} stream_capture_header_t;
+
+typedef struct {
+    uint64_t        arrivalTime;    // CLOCK_MONOTONIC [ns] at capture
+    uint32_t        stream;
+    uint32_t        size;
+} stream_capture_record_t;
+
+class IStreamRecorder;
+typedef shared_ptr<IStreamRecorder> StreamRecorder;
+
+/* Stream sink writing every frame of the streams it is attached to into a
+ * capture file. Returns a null pointer if the file cannot be created.
+ */
+class IStreamRecorder : public IStreamFrameSink {
+public:
+    static StreamRecorder create(const char *fileName, const stream_format_t format[MAX_DEBUG_STREAM]);
+
+    virtual void     close()     = 0;
+    virtual uint64_t getFrames() = 0;
+    virtual uint64_t getBytes()  = 0;
+};
+
+class IStreamReplay;
+typedef shared_ptr<IStreamReplay> StreamReplay;
+
+/* Plays a capture file back behind the IATCADebugStream interface.
+ *
+ * speed scales the recorded inter-frame timing (1.0 original, 2.0 twice as
+ * fast); 0 replays as fast as the readers consume. Playback starts with
+ * createStreams(), whose arguments are ignored. Each stream queues up to
+ * queueDepth frames and getStreamLoss() reports pause while its queue is
+ * full. In timed replay, frames arriving at a full queue are dropped and
+ * reported as overflow, the other streams keep playing. At speed 0 the
+ * file is read in order as fast as the slowest reader, so one full queue
+ * holds every stream. stop() ends playback; frames already queued can
+ * still be read. Returns a null pointer if the file is not a valid
+ * capture.
+ */
+class IStreamReplay : public IATCADebugStream {
+public:
+    static StreamReplay create(const char *fileName, double speed, bool loop = false, unsigned queueDepth = 256);
+
+    virtual void stop() = 0;
+    virtual bool done() = 0;     // whole file delivered, or stopped, and read
+};
+
+#endif /* _STREAM_REPLAY_H */
@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_SIMD_H
+#define _STREAM_SIMD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define SIMD_WIDTH 8
+
+/* GCC generic vectors; lowered to SSE/AVX/NEON or scalar code by the compiler */
+typedef float    v8sf __attribute__ ((vector_size (SIMD_WIDTH * sizeof(float))));
+typedef double   v8df __attribute__ ((vector_size (SIMD_WIDTH * sizeof(double))));
+typedef int32_t  v8si __attribute__ ((vector_size (SIMD_WIDTH * sizeof(int32_t))));
+typedef int16_t  v8hi __attribute__ ((vector_size (SIMD_WIDTH * sizeof(int16_t))));
+typedef uint16_t v8hu __attribute__ ((vector_size (SIMD_WIDTH * sizeof(uint16_t))));
+
+/* __builtin_convertvector needs GCC 9 or clang; older compilers
+ * (buildroot-2019.08, rhel7) widen element by element */
+#if defined(__clang__) || __GNUC__ >= 9
+#define SIMD_CONVERT(d, s, type)    (*(d) = __builtin_convertvector(s, type))
+#else
+#define SIMD_CONVERT(d, s, type)    do { for(int _k = 0; _k < SIMD_WIDTH; _k++) (*(d))[_k] = (s)[_k]; } while(0)
+#endif
+
+/* load SIMD_WIDTH contiguous samples and widen them to 32 bit; x needs
+ * no alignment */
+static inline void simdLoad(v8si *v, const int32_t *x)
+{
+    memcpy(v, x, sizeof(*v));
+}
+
+static inline void simdLoad(v8si *v, const int16_t *x)
+{
+    v8hi h;
+    memcpy(&h, x, sizeof(h));
+    SIMD_CONVERT(v, h, v8si);
+}
+
+static inline void simdLoad(v8si *v, const uint16_t *x)
+{
+    v8hu h;
+    memcpy(&h, x, sizeof(h));
+    SIMD_CONVERT(v, h, v8si);
+}
+
+static inline void simdLoad(v8sf *v, const float *x)
+{
+    memcpy(v, x, sizeof(*v));
+}
+
+/* widen to double for sums that would overflow 32 bit */
+static inline void simdWiden(v8df *d, const v8si *v)
+{
+    SIMD_CONVERT(d, *v, v8df);
+}
+
+#endif /* _STREAM_SIMD_H */
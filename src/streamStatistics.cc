@@ -0,0 +1,209 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <mutex>
+
+#include "streamStatistics.h"
+#include "streamSimd.h"
+
+template <typename T>
+static void sampleStats(const T *x, uint64_t n, channel_stats_t *stats)
+{
+    v8si     vmin, vmax, v;
+    v8df     sum = { 0 }, sq = { 0 }, d;
+    uint64_t i   = 0;
+    int32_t  min = INT32_MAX, max = INT32_MIN;
+    double   s   = 0., s2 = 0.;
+
+    for(int k = 0; k < SIMD_WIDTH; k++) {
+        vmin[k] = INT32_MAX;
+        vmax[k] = INT32_MIN;
+    }
+
+    for(; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdLoad(&v, x + i);
+        simdWiden(&d, &v);
+        vmin = v < vmin ? v : vmin;
+        vmax = v > vmax ? v : vmax;
+        sum += d;
+        sq  += d * d;
+    }
+
+    for(int k = 0; k < SIMD_WIDTH; k++) {
+        if(vmin[k] < min) min = vmin[k];
+        if(vmax[k] > max) max = vmax[k];
+        s  += sum[k];
+        s2 += sq[k];
+    }
+    for(; i < n; i++) {
+        int32_t y = x[i];
+        if(y < min) min = y;
+        if(y > max) max = y;
+        s  += y;
+        s2 += (double) y * y;
+    }
+
+    stats->samples = n;
+    if(!n) {
+        stats->min = stats->max = stats->peak = 0;
+        stats->mean = stats->rms = 0.;
+        stats->peakIndex = 0;
+        return;
+    }
+
+    stats->min  = min;
+    stats->max  = max;
+    stats->mean = s / n;
+    stats->rms  = sqrt(s2 / n);
+    stats->peak = -(int64_t) min > (int64_t) max ? min : max;
+
+    /* the peak value is known, find its first occurrence */
+    for(i = 0; i < n && (int32_t) x[i] != stats->peak; i++)
+        ;
+    stats->peakIndex = i;
+}
+
+
+typedef struct {
+    std::mutex            lock;
+    stream_format_t       format;
+    bool                  keep;
+    bool                  wanted;       // copy the next frame for getWaveform()
+    bool                  valid;
+    channel_stats_t       stats;
+    channel_stats_t       frameStats;   // stats of the kept frame
+    stream_format_t       frameFormat;  // format the kept frame was taken with
+    std::vector<uint8_t>  frame;        // raw frame of frameStats, if kept
+} stats_stream_t;
+
+class CStreamStatistics : public IStreamStatistics {
+    protected:
+        stats_stream_t                  _stream[MAX_DEBUG_STREAM];
+        std::vector<ChannelStatsSink>   _sinks;
+
+    public:
+        CStreamStatistics();
+
+        virtual void setFormat(uint32_t stream, const stream_format_t *format);
+        virtual void setKeepWaveform(uint32_t stream, bool keep);
+        virtual void addStatsSink(ChannelStatsSink sink);
+        virtual void processFrame(const stream_frame_t *frame);
+        virtual int      getStats(channel_stats_t *stats, uint32_t stream);
+        virtual uint64_t getWaveform(uint32_t stream, int32_t *samples, uint64_t maxSamples, channel_stats_t *stats);
+};
+
+StreamStatistics IStreamStatistics::create()
+{
+    return StreamStatistics(new CStreamStatistics());
+}
+
+CStreamStatistics::CStreamStatistics()
+{
+    for(int i = 0; i < MAX_DEBUG_STREAM; i++) {
+        memset(&_stream[i].format, 0, sizeof(stream_format_t));
+        memset(&_stream[i].stats,  0, sizeof(channel_stats_t));
+        _stream[i].keep   = false;
+        _stream[i].wanted = false;
+        _stream[i].valid  = false;
+    }
+}
+
+void CStreamStatistics::setFormat(uint32_t stream, const stream_format_t *format)
+{
+    std::lock_guard<std::mutex> lock(_stream[stream].lock);
+    _stream[stream].format = *format;
+}
+
+void CStreamStatistics::setKeepWaveform(uint32_t stream, bool keep)
+{
+    std::lock_guard<std::mutex> lock(_stream[stream].lock);
+    _stream[stream].keep   = keep;
+    _stream[stream].wanted = keep;
+    if(!keep) std::vector<uint8_t>().swap(_stream[stream].frame);
+}
+
+void CStreamStatistics::addStatsSink(ChannelStatsSink sink)
+{
+    _sinks.push_back(sink);
+}
+
+void CStreamStatistics::processFrame(const stream_frame_t *frame)
+{
+    if(frame->stream >= MAX_DEBUG_STREAM)
+        return;
+
+    stats_stream_t  *c = &_stream[frame->stream];
+    channel_stats_t  stats;
+    daqmux_header_t  header;
+    uint64_t         bytes;
+    const uint8_t   *p;
+    {
+        std::lock_guard<std::mutex> lock(c->lock);
+
+        p = streamPayload(frame, &c->format, &bytes);
+        if(!c->format.dataWidth)
+            sampleStats((const int32_t *) p, bytes / sizeof(int32_t), &stats);
+        else if(c->format.sign)
+            sampleStats((const int16_t *) p, bytes / sizeof(int16_t), &stats);
+        else
+            sampleStats((const uint16_t *) p, bytes / sizeof(uint16_t), &stats);
+
+        stats.frame       = c->valid ? c->stats.frame + 1 : 0;
+        stats.arrivalTime = frame->arrivalTime;
+        stats.timestamp   = (c->format.header && !parseStreamHeader(frame, &header)) ?
+                            streamHeaderTimestamp(&header) : 0;
+
+        /* copy only after a reader took the previous one */
+        if(c->wanted) {
+            c->frame.assign(frame->data, frame->data + frame->size);
+            c->frameStats  = stats;
+            c->frameFormat = c->format;
+            c->wanted      = false;
+        }
+        c->stats = stats;
+        c->valid = true;
+    }
+
+    for(unsigned i = 0; i < _sinks.size(); i++)
+        _sinks[i]->processStats(frame->stream, &stats);
+}
+
+int CStreamStatistics::getStats(channel_stats_t *stats, uint32_t stream)
+{
+    std::lock_guard<std::mutex> lock(_stream[stream].lock);
+
+    if(!_stream[stream].valid)
+        return -1;
+    *stats = _stream[stream].stats;
+    return 0;
+}
+
+uint64_t CStreamStatistics::getWaveform(uint32_t stream, int32_t *samples, uint64_t maxSamples, channel_stats_t *stats)
+{
+    stats_stream_t *c = &_stream[stream];
+    stream_frame_t  frame;
+    std::lock_guard<std::mutex> lock(c->lock);
+
+    c->wanted = c->keep;
+    if(c->frame.empty())
+        return 0;
+
+    frame.stream      = stream;
+    frame.data        = c->frame.data();
+    frame.size        = c->frame.size();
+    frame.arrivalTime = c->frameStats.arrivalTime;
+    frame.readyTime   = 0;
+
+    if(stats) *stats = c->frameStats;
+    return decodeStreamSamples(&frame, &c->frameFormat, samples, maxSamples);
+}
@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _STREAM_STATISTICS_H
+#define _STREAM_STATISTICS_H
+
+#include "streamFrame.h"
+
+typedef struct {
+    uint64_t  frame;          // frames seen on this stream since create()
+    uint64_t  timestamp;      // header timestamp (sec << 32 | nsec), 0 without header
+    uint64_t  arrivalTime;    // CLOCK_MONOTONIC [ns]
+    uint64_t  samples;
+    int32_t   min;
+    int32_t   max;
+    double    mean;
+    double    rms;
+    int32_t   peak;           // sample with the largest magnitude
+    uint64_t  peakIndex;      // first occurrence of peak
+} channel_stats_t;
+
+class IChannelStatsSink;
+typedef shared_ptr<IChannelStatsSink> ChannelStatsSink;
+
+/* Called from the stream reader thread for every frame */
+class IChannelStatsSink {
+public:
+    virtual void processStats(uint32_t stream, const channel_stats_t *stats) = 0;
+    virtual ~IChannelStatsSink() {}
+};
+
+class IStreamStatistics;
+typedef shared_ptr<IStreamStatistics> StreamStatistics;
+
+/* Per frame min/max/mean/RMS/peak of the debug streams.
+ *
+ * The statistics are computed in the reader thread directly on the
+ * 16 or 32 bit payload, no samples are copied. For streams with
+ * setKeepWaveform() enabled one raw frame is retained: the first frame
+ * after enabling, then the first frame after each getWaveform() call, so
+ * frames nobody reads are not copied. getWaveform() hence returns the
+ * frame that followed the previous call, which is as old as the gap
+ * between calls; stats->arrivalTime tells its age. The frame is decoded
+ * with the format it arrived under. Configure formats, sinks and
+ * waveform retention before attaching with addStreamSink().
+ */
+class IStreamStatistics : public IStreamFrameSink {
+public:
+    static StreamStatistics create();
+
+    virtual void setFormat(uint32_t stream, const stream_format_t *format) = 0;
+    virtual void setKeepWaveform(uint32_t stream, bool keep) = 0;
+    virtual void addStatsSink(ChannelStatsSink sink) = 0;
+
+    /* latest frame; return -1 if no frame was seen yet */
+    virtual int      getStats(channel_stats_t *stats, uint32_t stream) = 0;
+    /* samples of the kept frame and its stats: the first frame after the
+     * previous call, possibly much older than getStats(); 0 if none kept yet */
+    virtual uint64_t getWaveform(uint32_t stream, int32_t *samples, uint64_t maxSamples, channel_stats_t *stats) = 0;
+};
+
+#endif /* _STREAM_STATISTICS_H */
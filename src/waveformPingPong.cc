@@ -0,0 +1,213 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "waveformPingPong.h"
+
+class CWaveformPingPong : public IWaveformPingPong {
+    protected:
+        ATCACommonFw              _fw;
+        int                       _index;
+        uint64_t                  _bankSize;
+        dram_region_size_t        _ramAllocatedSize;
+        uint32_t                  _channelMask;
+        unsigned                  _period;
+        WaveformBankSink          _sink;
+        uint64_t                  _base[WFE_CHANNEL_CNT];
+        int                       _armed;           // bank being captured into
+        bool                      _released[2];
+        std::mutex                _lock;
+        std::condition_variable   _cond;
+        std::thread               _thread;
+        bool                      _run;
+        wfe_ping_pong_stats_t     _stats;
+
+        void arm(int bank);
+        bool captureDone();
+        void pingPongLoop();
+
+    public:
+        CWaveformPingPong(ATCACommonFw fw, int index, uint64_t bankSize, dram_region_size_t ramAllocatedSize,
+                          uint32_t channelMask, unsigned period, WaveformBankSink sink);
+        virtual ~CWaveformPingPong();
+
+        virtual int  start();
+        virtual void stop();
+        virtual void release(int bank);
+        virtual void getStats(wfe_ping_pong_stats_t *stats);
+};
+
+WaveformPingPong IWaveformPingPong::create(ATCACommonFw fw, int index, uint64_t bankSize, dram_region_size_t ramAllocatedSize,
+                                           uint32_t channelMask, unsigned period, WaveformBankSink sink)
+{
+    return WaveformPingPong(new CWaveformPingPong(fw, index, bankSize, ramAllocatedSize, channelMask, period, sink));
+}
+
+CWaveformPingPong::CWaveformPingPong(ATCACommonFw fw, int index, uint64_t bankSize, dram_region_size_t ramAllocatedSize,
+                                     uint32_t channelMask, unsigned period, WaveformBankSink sink) :
+    _fw(fw),
+    _index(index),
+    _bankSize(bankSize),
+    _ramAllocatedSize(ramAllocatedSize),
+    _channelMask(channelMask),
+    _period(period),
+    _sink(sink),
+    _armed(0),
+    _run(false)
+{
+    _released[0] = _released[1] = true;
+    _stats.captures = 0;
+    _stats.stalls   = 0;
+}
+
+CWaveformPingPong::~CWaveformPingPong()
+{
+    stop();
+}
+
+int CWaveformPingPong::start()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(_run)
+        return 0;
+
+    try {
+        if(_fw->setupWaveformEngine(_index, 2 * _bankSize, _ramAllocatedSize))
+            return -1;
+        for(int j = 0; j < WFE_CHANNEL_CNT; j++) _fw->getWfEngineStartAddr(&_base[j], _index, j);
+        arm(0);
+    } catch (CPSWError &e) {
+        return -1;
+    }
+
+    _released[0] = _released[1] = true;
+    _run    = true;
+    _thread = std::thread(&CWaveformPingPong::pingPongLoop, this);
+    return 0;
+}
+
+void CWaveformPingPong::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        if(!_run)
+            return;
+        _run = false;
+        _cond.notify_all();
+    }
+    _thread.join();
+}
+
+void CWaveformPingPong::release(int bank)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _released[bank & 1] = true;
+    _cond.notify_all();
+}
+
+void CWaveformPingPong::getStats(wfe_ping_pong_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    *stats = _stats;
+}
+
+void CWaveformPingPong::arm(int bank)
+{
+    for(int j = 0; j < WFE_CHANNEL_CNT; j++) {
+        uint64_t start = _base[j] + bank * _bankSize;
+        _fw->setWfEngineStartAddr(start, _index, j);
+        _fw->setWfEngineEndAddr(start + _bankSize, _index, j);
+    }
+    _fw->initWfEngine(_index);
+    _armed = bank;
+}
+
+bool CWaveformPingPong::captureDone()
+{
+    uint32_t status;
+
+    for(int j = 0; j < WFE_CHANNEL_CNT; j++) {
+        if(!(_channelMask & (1 << j)))
+            continue;
+        _fw->getWfEngineStatus(&status, _index, j);
+        if(!(status & WFE_STATUS_FULL))
+            return false;
+    }
+    return true;
+}
+
+void CWaveformPingPong::pingPongLoop()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while(_run) {
+        _cond.wait_for(lock, std::chrono::microseconds(_period));
+        if(!_run)
+            break;
+
+        wfe_bank_t bank;
+        lock.unlock();
+        try {
+            if(!captureDone()) {
+                lock.lock();
+                continue;
+            }
+            bank.index = _index;
+            bank.bank  = _armed;
+            bank.time  = streamMonotonicTime();
+            for(int j = 0; j < WFE_CHANNEL_CNT; j++) {
+                uint64_t wrAddr;
+                bank.addr[j] = _base[j] + _armed * _bankSize;
+                bank.size[j] = 0;
+                if(!(_channelMask & (1 << j)))
+                    continue;
+                /* a full channel normally has WrAddr at EndAddr */
+                _fw->getWfEngineWrAddr(&wrAddr, _index, j);
+                bank.size[j] = (wrAddr > bank.addr[j] && wrAddr <= bank.addr[j] + _bankSize) ?
+                               wrAddr - bank.addr[j] : _bankSize;
+            }
+        } catch (CPSWError &e) {
+            /* already reported by the adapter, try again next period */
+            lock.lock();
+            continue;
+        }
+        lock.lock();
+
+        int next = _armed ^ 1;
+        if(!_released[next]) {
+            _stats.stalls++;
+            while(_run && !_released[next]) _cond.wait(lock);
+            if(!_run)
+                break;
+        }
+        _released[_armed] = false;
+        _released[next]   = false;      /* armed banks belong to the engine */
+        bank.sequence     = _stats.captures;
+
+        lock.unlock();
+        try {
+            arm(next);
+        } catch (CPSWError &e) {
+            /* the engine still holds the capture, deliver it once re-arming works */
+            fprintf(stderr, "IWaveformPingPong: cannot re-arm waveform engine %d\n", _index);
+            lock.lock();
+            _released[0] = _released[1] = true;
+            continue;
+        }
+        if(_sink) _sink->bankReady(&bank);
+        lock.lock();
+        _stats.captures++;
+    }
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'commonATCA'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'commonATCA', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef _WAVEFORM_PING_PONG_H
+#define _WAVEFORM_PING_PONG_H
+
+#include "atcaCommon.h"
+
+/* A completed capture, in DRAM addresses */
+typedef struct {
+    int       index;                      // waveform engine
+    int       bank;                       // 0 or 1
+    uint64_t  sequence;                   // captures completed since start()
+    uint64_t  time;                       // CLOCK_MONOTONIC [ns] when the capture was seen done
+    uint64_t  addr[WFE_CHANNEL_CNT];
+    uint64_t  size[WFE_CHANNEL_CNT];      // bytes written, 0 for channels not in use
+} wfe_bank_t;
+
+typedef struct {
+    uint64_t  captures;
+    uint64_t  stalls;                     // captures held because the other bank was not released
+} wfe_ping_pong_stats_t;
+
+class IWaveformBankSink;
+typedef shared_ptr<IWaveformBankSink> WaveformBankSink;
+
+/* Called from the ping-pong thread after the engine was re-armed into the
+ * other bank; release() the bank once it has been read out.
+ */
+class IWaveformBankSink {
+public:
+    virtual void bankReady(const wfe_bank_t *bank) = 0;
+    virtual ~IWaveformBankSink() {}
+};
+
+class IWaveformPingPong;
+typedef shared_ptr<IWaveformPingPong> WaveformPingPong;
+
+/* Double buffered waveform engine capture.
+ *
+ * start() sets the engine up with setupWaveformEngine() for two banks of
+ * bankSize bytes per channel and arms bank 0. A helper thread polls the
+ * Status of the channels in channelMask every period us; once all of them
+ * are full it points StartAddr/EndAddr at the other bank, re-initializes
+ * the engine and hands the completed bank to the sink. Readout of capture
+ * N thus overlaps capture N+1; the dead time is the poll latency plus a
+ * few register writes. Size the banks to one acquisition (DataBufferSize).
+ *
+ * A bank is only re-armed after release(); if the consumer is still
+ * holding it when the other capture completes, the engine stays stopped
+ * until release() and the capture counts as a stall.
+ */
+class IWaveformPingPong {
+public:
+    static WaveformPingPong create(ATCACommonFw fw, int index, uint64_t bankSize, dram_region_size_t ramAllocatedSize,
+                                   uint32_t channelMask, unsigned period, WaveformBankSink sink);
+
+    /* return -1 if the engine cannot be set up */
+    virtual int  start() = 0;
+    virtual void stop()  = 0;
+    virtual void release(int bank) = 0;
+    virtual void getStats(wfe_ping_pong_stats_t *stats) = 0;
+    virtual ~IWaveformPingPong() {}
+};
+
+#endif /* _WAVEFORM_PING_PONG_H */